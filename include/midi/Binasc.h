@@ -4,7 +4,7 @@
 // Last Modified: Sat Apr 21 10:52:19 PDT 2018 Removed using namespace std;
 // Filename:      midifile/include/Binasc.h
 // Website:       http://midifile.sapp.org
-// Syntax:        C++11
+// Syntax:        C++17
 // vim:           ts=3 noexpandtab
 //
 // description:   Interface to convert bytes between binary and ASCII forms.
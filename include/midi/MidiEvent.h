@@ -4,7 +4,7 @@
 // Last Modified: Sat Apr 21 10:52:19 PDT 2018 Removed using namespace std;
 // Filename:      midifile/include/MidiEvent.h
 // Website:       http://midifile.sapp.org
-// Syntax:        C++11
+// Syntax:        C++17
 // vim:           ts=3 noexpandtab
 //
 // Description:   A class which stores a MidiMessage and a timestamp
@@ -17,6 +17,7 @@
 #include "MidiMessage.h"
 
 #include <ostream>
+#include <string>
 #include <vector>
 
 namespace smf {
@@ -29,6 +30,7 @@ class MidiEvent : public MidiMessage {
 		           MidiEvent             (int command, int param1, int param2);
 		           MidiEvent             (const MidiMessage& message);
 		           MidiEvent             (const MidiEvent& mfevent);
+		           MidiEvent             (MidiEvent&& mfevent) noexcept;
 		           MidiEvent             (int aTime, int aTrack,
 		                                  std::vector<uchar>& message);
 
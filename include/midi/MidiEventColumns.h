@@ -0,0 +1,90 @@
+//
+// Creation Date: Mon Oct 19 17:26:40 PDT 2026
+// Filename:      midifile/include/MidiEventColumns.h
+// Website:       http://midifile.sapp.org
+// Syntax:        C++17
+// vim:           ts=3 noexpandtab
+//
+// Description:   A columnar copy of the events in a MidiFile: one array
+//                for each field (tick, track, status byte, two data bytes
+//                and the index of the event in its track), so that analysis
+//                passes can scan plain arrays instead of MidiEvent objects.
+//                The columns are a snapshot of the file, and they must be
+//                rebuilt with build() after the events are changed.  Common
+//                scans (note-on counts, pitch histogram, onsets and tick
+//                ranges) are vectorized, with the instruction set chosen
+//                at runtime.
+//
+
+#ifndef _MIDIEVENTCOLUMNS_H_INCLUDED
+#define _MIDIEVENTCOLUMNS_H_INCLUDED
+
+#include "MidiFile.h"
+
+#include <vector>
+
+namespace smf {
+
+class MidiEventColumns {
+	public:
+		                MidiEventColumns (void);
+		                MidiEventColumns (const MidiFile& midifile);
+		               ~MidiEventColumns ();
+
+		void            build            (const MidiFile& midifile);
+		void            clear            (void);
+		int             size             (void) const;
+		int             getTrackCount    (void) const;
+		int             getTrackStart    (int track) const;
+		int             getTrackEnd      (int track) const;
+
+		// Column arrays, each with size() entries:
+		const int*      getTicks         (void) const;
+		const int*      getTracks        (void) const;
+		const int*      getIndexes       (void) const;
+		const uchar*    getStatus        (void) const;
+		const uchar*    getData1         (void) const;
+		const uchar*    getData2         (void) const;
+
+		// Scans over all rows, using SSE2 or AVX2 when available:
+		void            getNoteOnCounts  (std::vector<int>& counts) const;
+		void            getPitchHistogram (std::vector<int>& histogram) const;
+		void            getNoteOnRows    (std::vector<int>& rows) const;
+		void            getOnsetTicks    (std::vector<int>& ticks) const;
+		void            getRowsInTickRange (int starttick, int endtick,
+		                                  std::vector<int>& rows) const;
+
+		// Instruction set used by the scans (0 = scalar, 1 = SSE2, 2 = AVX2):
+		static int      getSimdLevel     (void);
+		static void     setSimdLevel     (int level);
+
+	private:
+		// m_ticks == Tick value of each event (absolute or delta, as in the
+		// MidiFile when the columns were built).
+		std::vector<int> m_ticks;
+
+		// m_tracks == Track of each event.
+		std::vector<int> m_tracks;
+
+		// m_indexes == Index of each event in its track.
+		std::vector<int> m_indexes;
+
+		// m_status == First byte of each event (0 for empty events).
+		std::vector<uchar> m_status;
+
+		// m_data1, m_data2 == Second and third byte of each event (0 if the
+		// event is shorter).  For meta messages m_data1 is the meta type.
+		std::vector<uchar> m_data1;
+		std::vector<uchar> m_data2;
+
+		// m_trackstart == Row of the first event of each track (with an
+		// extra entry for the end of the last track).
+		std::vector<int> m_trackstart;
+};
+
+} // end of namespace smf
+
+#endif /* _MIDIEVENTCOLUMNS_H_INCLUDED */
+
+
+
@@ -4,7 +4,7 @@
 // Last Modified: Sat Apr 21 10:52:19 PDT 2018 Removed using namespace std;
 // Filename:      midifile/include/MidiEventList.h
 // Website:       http://midifile.sapp.org
-// Syntax:        C++11
+// Syntax:        C++17
 // vim:           ts=3 noexpandtab
 //
 // Description:   A class that stores a MidiEvents for a MidiFile track.
@@ -14,6 +14,8 @@
 #define _MIDIEVENTLIST_H_INCLUDED
 
 #include "MidiEvent.h"
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 namespace smf {
@@ -47,14 +49,26 @@ class MidiEventList {
 		void             clearLinks         (void);
 		void             clearSequence      (void);
 		int              markSequence       (int sequence = 1);
+		void             makeContiguous     (void);
+		bool             isContiguous       (void) const;
+		bool             getTickRange       (int starttick, int endtick,
+		                                     int& startindex, int& endindex) const;
+		void             clearTickIndex     (void);
 
 		int              push               (MidiEvent& event);
 		int              push_back          (MidiEvent& event);
 		int              append             (MidiEvent& event);
+		int              insertSorted       (MidiEvent& event);
+		void             insertSorted       (const std::vector<MidiEvent>& events,
+		                                     int track = -1);
 
 		// careful when using these, intended for internal use in MidiFile class:
 		void             detach             (void);
 		int              push_back_no_copy  (MidiEvent* event);
+		void             shareBlocks        (const MidiEventList& other);
+		void             reserveBlock       (int count);
+		MidiEvent*       newEvent           (void);
+		void             deleteEvent        (MidiEvent* event);
 
 		// access to the list of MidiEvents for sorting with an external function:
 		MidiEvent**      data               (void);
@@ -62,8 +76,51 @@ class MidiEventList {
 	protected:
 		std::vector<MidiEvent*> list;
 
+		// blocks == Contiguous arrays of MidiEvents which are pointed to by
+		// the list (see makeContiguous()).  Blocks are never resized after
+		// they are filled, so the event addresses stay valid, and they are
+		// shared with other lists which take over some of their events.
+		// The blocks are kept in order of their addresses so that the block
+		// of an event can be found with a binary search.
+		std::vector<std::shared_ptr<std::vector<MidiEvent>>> blocks;
+
+		// fillblock == Block (one of blocks) in which newEvent() stores
+		// events, or NULL if there is none.
+		std::vector<MidiEvent>* fillblock = NULL;
+
 	private:
+		// SortKey == Precomputed sorting order of the event at a list index
+		// (see sort()).
+		struct SortKey {
+			uint64_t primary;
+			uint32_t secondary;
+			int      index;
+			bool     operator<   (const SortKey& other) const;
+		};
+
 		void             sort                (void);
+		bool             makeSortKeys        (std::vector<SortKey>& keys,
+		                                      bool useseq) const;
+		int              getSequenceState    (void) const;
+		static uint64_t  getSortPrimary      (const MidiEvent& event, bool useseq);
+		static uint32_t  getSortSecondary    (const MidiEvent& event);
+		static SortKey   getSortKey          (const MidiEvent& event, bool useseq,
+		                                      int index);
+		int              prepareSortedInsert (int seqstate);
+		static bool      isKeyBefore         (const SortKey& key,
+		                                      const MidiEvent& event, int mode);
+		bool             isSortedBy          (bool useseq) const;
+		bool             isBlockEvent        (const MidiEvent* event) const;
+		int              findBlock           (const MidiEvent* event) const;
+		void             addBlock            (const std::shared_ptr<std::vector<MidiEvent>>& block);
+		bool             isTickSorted        (void) const;
+
+		// sortorder == Order of the events, for getTickRange() and
+		// insertSorted(): -1 = not checked yet, 0 = not in tick order,
+		// 1 = in tick order, 2 = sorted as by sort() without sequence
+		// numbers, 3 = sorted by sort() with sequence numbers.  It is
+		// reset whenever the list is changed in other ways.
+		mutable int sortorder = -1;
 
 	// MidiFile class calls sort()
 	friend class MidiFile;
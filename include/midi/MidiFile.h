@@ -4,7 +4,7 @@
 // Last Modified: Mon Jan 18 20:54:04 PST 2021 Added readSmf().
 // Filename:      midifile/include/MidiFile.h
 // Website:       http://midifile.sapp.org
-// Syntax:        C++11
+// Syntax:        C++17
 // vim:           ts=3 noexpandtab
 //
 // Description:   A class that can read/write Standard MIDI files.
@@ -20,6 +20,8 @@
 #include <string>
 #include <istream>
 #include <fstream>
+#include <functional>
+#include <atomic>
 
 #define TIME_STATE_DELTA       0
 #define TIME_STATE_ABSOLUTE    1
@@ -27,6 +29,22 @@
 #define TRACK_STATE_SPLIT      0
 #define TRACK_STATE_JOINED     1
 
+// Message types for MidiFile::setReadFilter().  End-of-track meta
+// messages are always kept.
+#define EVENT_TYPE_NOTE        0x0001   // note-ons and note-offs
+#define EVENT_TYPE_AFTERTOUCH  0x0002   // polyphonic key pressure
+#define EVENT_TYPE_CONTROLLER  0x0004
+#define EVENT_TYPE_PATCH       0x0008
+#define EVENT_TYPE_PRESSURE    0x0010   // channel pressure
+#define EVENT_TYPE_PITCHBEND   0x0020
+#define EVENT_TYPE_SYSEX       0x0040   // 0xf0 and 0xf7 messages
+#define EVENT_TYPE_TEMPO       0x0080
+#define EVENT_TYPE_TIMESIG     0x0100
+#define EVENT_TYPE_KEYSIG      0x0200
+#define EVENT_TYPE_TEXT        0x0400   // text metas 0x01 to 0x0f
+#define EVENT_TYPE_META        0x0800   // all other meta messages
+#define EVENT_TYPE_ALL         0x0fff
+
 namespace smf {
 
 class _TickTime {
@@ -36,6 +54,41 @@ class _TickTime {
 };
 
 
+// MidiFileSummary == Header and meta-event statistics for a Standard MIDI
+// File which are collected by MidiFile::scan() without creating MidiEvents.
+class MidiFileSummary {
+	public:
+		class TempoChange {
+			public:
+				int tick;
+				int microseconds;
+		};
+
+		class TimeSignature {
+			public:
+				int tick;
+				int top;
+				int bottom;
+		};
+
+		void       clear              (void);
+
+		int        type                = 0;   // 0 or 1
+		int        trackCount          = 0;
+		int        ticksPerQuarterNote = 0;
+		int        eventCount          = 0;   // including meta/sysex events
+		int        noteCount           = 0;   // note-ons with non-zero velocity
+		int        durationInTicks     = 0;   // absolute tick of last event
+		double     durationInSeconds   = 0.0;
+
+		// tempo and time signature changes are sorted by absolute tick,
+		// and track names are indexed by track (empty if not given).
+		std::vector<TempoChange>   tempos;
+		std::vector<TimeSignature> timeSignatures;
+		std::vector<std::string>   trackNames;
+};
+
+
 class MidiFile {
 	public:
 		               MidiFile                    (void);
@@ -57,21 +110,67 @@ class MidiFile {
 		bool           readBase64                  (const std::string& base64data);
 		bool           readBase64                  (std::istream& instream);
 
+		// Parse bytes which are already in memory (SMF or binasc), and
+		// base64 decoding into a reusable buffer:
+		bool           read                        (const uchar* data, size_t size);
+		bool           readBase64                  (const std::string& base64data,
+		                                            std::vector<uchar>& buffer);
+
 		// Only allow Standard MIDI File input:
 		bool           readSmf                     (const std::string& filename);
 		bool           readSmf                     (std::istream& instream);
-
-		bool           write                       (const std::string& filename);
-		bool           write                       (std::ostream& out);
-		bool           writeBase64                 (const std::string& out, int width = 0);
-		bool           writeBase64                 (std::ostream& out, int width = 0);
-		std::string    getBase64                   (int width = 0);
-		bool           writeHex                    (const std::string& filename, int width = 25);
-		bool           writeHex                    (std::ostream& out, int width = 25);
-		bool           writeBinasc                 (const std::string& filename);
-		bool           writeBinasc                 (std::ostream& out);
-		bool           writeBinascWithComments     (const std::string& filename);
-		bool           writeBinascWithComments     (std::ostream& out);
+		bool           readSmf                     (const uchar* data, size_t size);
+
+		// Drop unwanted messages while reading (EVENT_TYPE_* mask and/or
+		// a predicate which returns true for events to keep):
+		void           setReadFilter               (int typemask);
+		void           setReadFilter               (std::function<bool(const MidiEvent&)> keep);
+		void           clearReadFilter             (void);
+		int            getReadFilter               (void) const;
+
+		// Keep sysex, text and sequencer-specific meta payloads in the
+		// input buffer instead of copying them into each MidiEvent (they
+		// are copied when an event is modified, see MidiMessage.h):
+		void           setPayloadViews             (bool state = true);
+		bool           hasPayloadViews             (void) const;
+
+		// Count the events of each track before parsing it, so that
+		// the event lists are allocated with their exact sizes:
+		void           setEventPrecount            (bool state = true);
+		bool           hasEventPrecount            (void) const;
+
+		// Store the events of each track in one block of memory:
+		void           setContiguousEvents         (bool state = true);
+		bool           hasContiguousEvents         (void) const;
+
+		// Omit repeated command bytes of channel messages when writing:
+		void           setRunningStatus            (bool state = true);
+		bool           hasRunningStatus            (void) const;
+
+		// Encode tracks in parallel when writing (0 = one per core):
+		void           setWriteThreads             (int count);
+		int            getWriteThreads             (void) const;
+
+		// Collect a MidiFileSummary without storing any MidiEvents:
+		static bool    scan                        (const std::string& filename,
+		                                            MidiFileSummary& summary);
+		static bool    scan                        (std::istream& instream,
+		                                            MidiFileSummary& summary);
+		static bool    scan                        (const uchar* data, size_t size,
+		                                            MidiFileSummary& summary);
+
+		bool           write                       (const std::string& filename) const;
+		bool           write                       (std::ostream& out) const;
+		bool           write                       (std::vector<uchar>& output) const;
+		bool           writeBase64                 (const std::string& out, int width = 0) const;
+		bool           writeBase64                 (std::ostream& out, int width = 0) const;
+		std::string    getBase64                   (int width = 0) const;
+		bool           writeHex                    (const std::string& filename, int width = 25) const;
+		bool           writeHex                    (std::ostream& out, int width = 25) const;
+		bool           writeBinasc                 (const std::string& filename) const;
+		bool           writeBinasc                 (std::ostream& out) const;
+		bool           writeBinascWithComments     (const std::string& filename) const;
+		bool           writeBinascWithComments     (std::ostream& out) const;
 		bool           status                      (void) const;
 
 		// track-related functions:
@@ -115,6 +214,7 @@ class MidiFile {
 		int              addTracks                 (int count);
 		void             deleteTrack               (int aTrack);
 		void             mergeTracks               (int aTrack1, int aTrack2);
+		void             mergeTracks               (const std::vector<int>& tracks);
 		int              getTrackCountAsType1      (void);
 
 		// ticks-per-quarter related functions:
@@ -128,13 +228,18 @@ class MidiFile {
 		void             doTimeAnalysis            (void);
 		double           getTimeInSeconds          (int aTrack, int anIndex);
 		double           getTimeInSeconds          (int tickvalue);
+		void             getTimeInSeconds          (const int* ticks, size_t count,
+		                                            double* seconds);
 		double           getAbsoluteTickTime       (double starttime);
+		void             getAbsoluteTickTime       (const double* seconds,
+		                                            size_t count, double* ticks);
 		int              getFileDurationInTicks    (void);
 		double           getFileDurationInQuarters (void);
 		double           getFileDurationInSeconds  (void);
 
 		// note-analysis functions:
 		int              linkNotePairs             (void);
+		int              linkNotePairs             (int threads);
 		int              linkEventPairs            (void);
 		void             clearLinks                (void);
 
@@ -147,10 +252,20 @@ class MidiFile {
 		                                            std::vector<uchar>& midiData);
 		MidiEvent*       addEvent                  (MidiEvent& mfevent);
 		MidiEvent*       addEvent                  (int aTrack, MidiEvent& mfevent);
+		MidiEvent*       insertEvent               (int aTrack, MidiEvent& mfevent);
+		void             insertEvents              (int aTrack,
+		                                            const std::vector<MidiEvent>& events);
 		MidiEvent&       getEvent                  (int aTrack, int anIndex);
 		const MidiEvent& getEvent                  (int aTrack, int anIndex) const;
 		int              getEventCount             (int aTrack) const;
 		int              getNumEvents              (int aTrack) const;
+		// Binary search for the events in a tick range of a sorted track.
+		// Call markTicksChanged() or sortTracks() after assigning ticks
+		// to events directly:
+		bool             getTickRange              (int aTrack, int starttick,
+		                                            int endtick, int& startindex,
+		                                            int& endindex);
+		void             markTicksChanged          (int aTrack = -1);
 		void             allocateEvents            (int track, int aSize);
 		void             erase                     (void);
 		void             clear                     (void);
@@ -255,6 +370,8 @@ class MidiFile {
 		static std::ostream& writeBigEndianDouble    (std::ostream& out,
 		                                              double value);
 		static std::string   getGMInstrumentName     (int patchIndex);
+		static bool          readAllBytes            (std::istream& input,
+		                                              std::vector<uchar>& buffer);
 
 	protected:
 		// m_events == Lists of MidiEvents for each MIDI file track.
@@ -286,29 +403,72 @@ class MidiFile {
 		std::vector<_TickTime> m_timemap;
 
 		// m_rwstatus == True if last read was successful, false if a problem.
-		bool m_rwstatus = true;
+		// Writing is const, but also sets the status.
+		mutable std::atomic<bool> m_rwstatus{true};
 
 		// m_linkedEventQ == True if link analysis has been done.
 		bool m_linkedEventsQ = false;
 
+		// m_readFilter == EVENT_TYPE_* mask of messages to store when reading.
+		int m_readFilter = EVENT_TYPE_ALL;
+
+		// m_readPredicate == Optional test for storing events when reading.
+		std::function<bool(const MidiEvent&)> m_readPredicate;
+
+		// m_payloadViews == True if meta/sysex payloads of events which are
+		// read from a file should point into m_rawdata instead of being
+		// copied into the events.
+		bool m_payloadViews = false;
+
+		// m_rawdata == The bytes of the last file read with payload views.
+		std::vector<uchar> m_rawdata;
+
+		// m_eventPrecount == True if track events are counted before
+		// they are parsed when reading.
+		bool m_eventPrecount = false;
+
+		// m_contiguousEvents == True if the events of each track are
+		// stored in one block when reading.
+		bool m_contiguousEvents = false;
+
+		// m_runningStatus == True if channel messages are written with
+		// running status.
+		bool m_runningStatus = false;
+
+		// m_writeThreads == Number of threads which encode tracks when
+		// writing (0 for one thread per processor core).
+		int m_writeThreads = 1;
+
 	private:
-		int         extractMidiData                 (std::istream& inputfile,
-		                                             std::vector<uchar>& array,
-		                                             uchar& runningCommand);
-		ulong       readVLValue                     (std::istream& inputfile);
-		ulong       unpackVLV                       (uchar a = 0, uchar b = 0,
-		                                             uchar c = 0, uchar d = 0,
-		                                             uchar e = 0);
-		void        writeVLValue                    (long aValue,
-		                                             std::vector<uchar>& data);
+		bool        readSmfBuffer                   (std::vector<uchar>& buffer);
+		bool        parseSmf                        (const uchar* data, size_t size);
+		static int  countTrackEvents                (const uchar* ptr,
+		                                             const uchar* end);
+		static int  getEventType                    (uchar command, uchar metatype);
+		bool        isFilteredEvent                 (uchar command, uchar metatype) const;
+		static ulong getVlvValue                    (long value);
+		static ulong getSysexLength                 (const MidiEvent& event);
+		static uchar* writeBigEndian                (uchar* ptr, ulong value,
+		                                             int bytes);
+		static bool isRunningStatus                 (const MidiEvent& event,
+		                                             int& status);
+		static void mergeEventLists                 (const std::vector<MidiEventList*>& lists,
+		                                             MidiEventList& output);
+		size_t      getTrackChunkSize               (int track) const;
+		uchar*      writeTrackChunk                 (int track, uchar* ptr) const;
 		int         makeVLV                         (uchar *buffer, int number);
-		static int  ticksearch                      (const void* A, const void* B);
-		static int  secondsearch                    (const void* A, const void* B);
 		void        buildTimeMap                    (void);
 		double      linearTickInterpolationAtSecond (double seconds);
 		double      linearSecondInterpolationAtTick (int ticktime);
-		std::string base64Encode                    (const std::string &input);
-		std::string base64Decode                    (const std::string &input);
+		double      interpolateTickAtSecond         (int startindex,
+		                                             double seconds) const;
+		double      interpolateSecondsAtTick        (int startindex,
+		                                             int ticktime) const;
+		static size_t getBase64Size                 (size_t size, int width);
+		static size_t base64Encode                  (const uchar* input, size_t size,
+		                                             char* output, int width);
+		static void base64Decode                    (const char* input, size_t size,
+		                                             std::vector<uchar>& output);
 
 		static const std::string encodeLookup;
 		static const std::vector<int> decodeLookup;
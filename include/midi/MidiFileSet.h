@@ -0,0 +1,133 @@
+//
+// Creation Date: Mon Oct 19 14:03:11 PDT 2026
+// Filename:      midifile/include/MidiFileSet.h
+// Website:       http://midifile.sapp.org
+// Syntax:        C++17
+// vim:           ts=3 noexpandtab
+//
+// Description:   A class which loads many Standard MIDI Files into shared
+//                arrays of event ticks and message bytes, so that a large
+//                collection of files does not need one MidiFile object
+//                (and one allocation per event) for each file.  Files in
+//                the set are accessed through lightweight view objects.
+//
+
+#ifndef _MIDIFILESET_H_INCLUDED
+#define _MIDIFILESET_H_INCLUDED
+
+#include "MidiMessage.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace smf {
+
+class MidiFileSet;
+
+
+// MidiEventView == A read-only MIDI message with its absolute tick.  The
+// bytes are in the same form as MidiEvent bytes (running status filled in,
+// meta messages with type and length, sysex messages without a length).
+class MidiEventView {
+	public:
+		int           tick;
+		const uchar*  data;
+		int           size;
+
+		int           getCommandByte     (void) const;
+		int           getCommandNibble   (void) const;
+		int           getChannelNibble   (void) const;
+		int           getP1              (void) const;
+		int           getP2              (void) const;
+		bool          isNoteOn           (void) const;
+		bool          isNoteOff          (void) const;
+		bool          isMeta             (void) const;
+		int           getMetaType        (void) const;
+		bool          isTempo            (void) const;
+		int           getTempoMicroseconds (void) const;
+		MidiMessage   getMessage         (void) const;
+};
+
+
+// MidiTrackView == The events of one track of a file in a MidiFileSet.
+class MidiTrackView {
+	public:
+		                MidiTrackView    (const MidiFileSet* set, int track);
+
+		int             size             (void) const;
+		MidiEventView   operator[]       (int index) const;
+
+	private:
+		const MidiFileSet* m_set;
+		int                m_track;   // index into all tracks of the set
+};
+
+
+// MidiFileView == One file in a MidiFileSet.
+class MidiFileView {
+	public:
+		                MidiFileView     (const MidiFileSet* set, int file);
+
+		int             getTrackCount    (void) const;
+		int             getTicksPerQuarterNote (void) const;
+		int             getEventCount    (void) const;
+		const std::string& getFilename   (void) const;
+		MidiTrackView   operator[]       (int track) const;
+
+	private:
+		const MidiFileSet* m_set;
+		int                m_file;
+};
+
+
+class MidiFileSet {
+	public:
+		                MidiFileSet      (void);
+		               ~MidiFileSet      ();
+
+		int             addFile          (const std::string& filename);
+		int             addFiles         (const std::vector<std::string>& filenames);
+		int             addData          (const uchar* data, size_t size,
+		                                  const std::string& name = "");
+		void            reserve          (int files, size_t events, size_t bytes);
+		void            clear            (void);
+		int             size             (void) const;
+		size_t          getEventCount    (void) const;
+		MidiFileView    operator[]       (int index) const;
+
+	private:
+		// m_ticks == Absolute tick of each event in all files.
+		std::vector<int> m_ticks;
+
+		// m_offsets == Start of the bytes of each event in m_bytes (with an
+		// extra entry at the end for the size of the last event).
+		std::vector<size_t> m_offsets;
+
+		// m_bytes == Message bytes of all events.
+		std::vector<uchar> m_bytes;
+
+		// m_trackstart == Index of the first event of each track (with an
+		// extra entry for the end of the last track).
+		std::vector<int> m_trackstart;
+
+		// m_filestart == Index of the first track of each file (with an
+		// extra entry for the end of the last file).
+		std::vector<int> m_filestart;
+
+		// m_tpq == Ticks per quarter note of each file.
+		std::vector<int> m_tpq;
+
+		// m_names == Filename (or given name) of each file.
+		std::vector<std::string> m_names;
+
+	friend class MidiTrackView;
+	friend class MidiFileView;
+};
+
+} // end of namespace smf
+
+#endif /* _MIDIFILESET_H_INCLUDED */
+
+
+
@@ -4,7 +4,7 @@
 // Last Modified: Sat Apr 21 10:52:19 PDT 2018 Removed using namespace std;
 // Filename:      midifile/include/MidiMessage.h
 // Website:       http://midifile.sapp.org
-// Syntax:        C++11
+// Syntax:        C++17
 // vim:           ts=3 noexpandtab
 //
 // Description:   Storage for bytes of a MIDI message for use in MidiFile
@@ -44,6 +44,57 @@ class MidiMessage : public std::vector<uchar> {
 		MidiMessage&   operator=            (const std::vector<char>& bytes);
 		MidiMessage&   operator=            (const std::vector<int>& bytes);
 
+		// Byte access which includes a payload view (see setPayloadView()).
+		// These hide the functions of std::vector.  The non-const ones copy
+		// a viewed payload into the message before returning, so that
+		// the bytes can be modified, as do the const functions which need
+		// the bytes in one array (data() and the iterators):
+		size_type      size                 (void) const;
+		bool           empty                (void) const;
+		const uchar&   operator[]           (size_type index) const;
+		uchar&         operator[]           (size_type index);
+		const uchar&   at                   (size_type index) const;
+		uchar&         at                   (size_type index);
+		const uchar&   front                (void) const;
+		uchar&         front                (void);
+		const uchar&   back                 (void) const;
+		uchar&         back                 (void);
+		const uchar*   data                 (void) const;
+		uchar*         data                 (void);
+		const_iterator begin                (void) const;
+		iterator       begin                (void);
+		const_iterator end                  (void) const;
+		iterator       end                  (void);
+		const_iterator cbegin               (void) const;
+		const_iterator cend                 (void) const;
+		const_reverse_iterator rbegin       (void) const;
+		reverse_iterator rbegin             (void);
+		const_reverse_iterator rend         (void) const;
+		reverse_iterator rend               (void);
+		void           resize               (size_type count);
+		void           resize               (size_type count, uchar value);
+		void           reserve              (size_type count);
+		void           clear                (void);
+		void           push_back            (uchar value);
+		void           pop_back             (void);
+		void           swap                 (MidiMessage& other);
+		template <class... Args>
+		iterator       insert               (Args&&... args);
+		template <class... Args>
+		iterator       erase                (Args&&... args);
+		template <class... Args>
+		void           assign               (Args&&... args);
+
+		// Meta and system-exclusive payloads, which may be read-only views
+		// into the input buffer of a MidiFile (see
+		// MidiFile::setPayloadViews()):
+		const uchar*   getPayload           (void) const;
+		int            getPayloadSize       (void) const;
+		bool           hasPayloadView       (void) const;
+		void           setPayloadView       (const uchar* data, int size);
+		void           materializePayload   (void);
+		MidiMessage    getFullMessage       (void) const;
+
 		void           sortTrack            (void);
 		void           sortTrackWithSequence(void);
 
@@ -196,9 +247,204 @@ class MidiMessage : public std::vector<uchar> {
 		void           makeTemperamentMeantoneCommaThird(int referencePitchClass = 2, int channelMask = 0b1111111111111111);
 		void           makeTemperamentMeantoneCommaHalf(int referencePitchClass = 2, int channelMask = 0b1111111111111111);
 
+	protected:
+		void           clearPayloadView     (void);
+		int            getPayloadStart      (void) const;
+
+	private:
+		// m_payload == Meta or sysex payload bytes which are stored after
+		// the message bytes, but are owned by the MidiFile which read them.
+		const uchar*   m_payload     = NULL;
+		int            m_payloadsize = 0;
+
 };
 
 
+
+//////////////////////////////
+//
+// Inline byte access functions of MidiMessage (see MidiMessage.cpp
+// for the payload view functions).
+//
+
+inline MidiMessage::size_type MidiMessage::size(void) const {
+	return std::vector<uchar>::size() + m_payloadsize;
+}
+
+inline bool MidiMessage::empty(void) const {
+	return std::vector<uchar>::empty() && (m_payloadsize == 0);
+}
+
+inline const uchar& MidiMessage::operator[](size_type index) const {
+	size_type headsize = std::vector<uchar>::size();
+	if (index < headsize) {
+		return std::vector<uchar>::operator[](index);
+	}
+	return m_payload[index - headsize];
+}
+
+inline uchar& MidiMessage::operator[](size_type index) {
+	materializePayload();
+	return std::vector<uchar>::operator[](index);
+}
+
+inline const uchar& MidiMessage::at(size_type index) const {
+	if (index >= size()) {
+		return std::vector<uchar>::at(index);  // throws std::out_of_range
+	}
+	return (*this)[index];
+}
+
+inline uchar& MidiMessage::at(size_type index) {
+	materializePayload();
+	return std::vector<uchar>::at(index);
+}
+
+inline const uchar& MidiMessage::front(void) const {
+	return (*this)[0];
+}
+
+inline uchar& MidiMessage::front(void) {
+	materializePayload();
+	return std::vector<uchar>::front();
+}
+
+inline const uchar& MidiMessage::back(void) const {
+	return (*this)[size() - 1];
+}
+
+inline uchar& MidiMessage::back(void) {
+	materializePayload();
+	return std::vector<uchar>::back();
+}
+
+inline const uchar* MidiMessage::data(void) const {
+	const_cast<MidiMessage*>(this)->materializePayload();
+	return std::vector<uchar>::data();
+}
+
+inline uchar* MidiMessage::data(void) {
+	materializePayload();
+	return std::vector<uchar>::data();
+}
+
+inline MidiMessage::const_iterator MidiMessage::begin(void) const {
+	const_cast<MidiMessage*>(this)->materializePayload();
+	return std::vector<uchar>::begin();
+}
+
+inline MidiMessage::iterator MidiMessage::begin(void) {
+	materializePayload();
+	return std::vector<uchar>::begin();
+}
+
+inline MidiMessage::const_iterator MidiMessage::end(void) const {
+	const_cast<MidiMessage*>(this)->materializePayload();
+	return std::vector<uchar>::end();
+}
+
+inline MidiMessage::iterator MidiMessage::end(void) {
+	materializePayload();
+	return std::vector<uchar>::end();
+}
+
+inline MidiMessage::const_iterator MidiMessage::cbegin(void) const {
+	return begin();
+}
+
+inline MidiMessage::const_iterator MidiMessage::cend(void) const {
+	return end();
+}
+
+inline MidiMessage::const_reverse_iterator MidiMessage::rbegin(void) const {
+	return const_reverse_iterator(end());
+}
+
+inline MidiMessage::reverse_iterator MidiMessage::rbegin(void) {
+	return reverse_iterator(end());
+}
+
+inline MidiMessage::const_reverse_iterator MidiMessage::rend(void) const {
+	return const_reverse_iterator(begin());
+}
+
+inline MidiMessage::reverse_iterator MidiMessage::rend(void) {
+	return reverse_iterator(begin());
+}
+
+inline void MidiMessage::resize(size_type count) {
+	materializePayload();
+	std::vector<uchar>::resize(count);
+}
+
+inline void MidiMessage::resize(size_type count, uchar value) {
+	materializePayload();
+	std::vector<uchar>::resize(count, value);
+}
+
+inline void MidiMessage::reserve(size_type count) {
+	std::vector<uchar>::reserve(count);
+}
+
+inline void MidiMessage::clear(void) {
+	clearPayloadView();
+	std::vector<uchar>::clear();
+}
+
+inline void MidiMessage::push_back(uchar value) {
+	materializePayload();
+	std::vector<uchar>::push_back(value);
+}
+
+inline void MidiMessage::pop_back(void) {
+	materializePayload();
+	std::vector<uchar>::pop_back();
+}
+
+inline void MidiMessage::swap(MidiMessage& other) {
+	std::vector<uchar>::swap(other);
+	std::swap(m_payload, other.m_payload);
+	std::swap(m_payloadsize, other.m_payloadsize);
+}
+
+template <class... Args>
+inline MidiMessage::iterator MidiMessage::insert(Args&&... args) {
+	materializePayload();
+	return std::vector<uchar>::insert(std::forward<Args>(args)...);
+}
+
+template <class... Args>
+inline MidiMessage::iterator MidiMessage::erase(Args&&... args) {
+	materializePayload();
+	return std::vector<uchar>::erase(std::forward<Args>(args)...);
+}
+
+template <class... Args>
+inline void MidiMessage::assign(Args&&... args) {
+	clearPayloadView();
+	std::vector<uchar>::assign(std::forward<Args>(args)...);
+}
+
+inline bool MidiMessage::hasPayloadView(void) const {
+	return m_payload != NULL;
+}
+
+inline void MidiMessage::materializePayload(void) {
+	if (m_payload != NULL) {
+		const uchar* payload = m_payload;
+		int          size    = m_payloadsize;
+		clearPayloadView();
+		std::vector<uchar>::insert(std::vector<uchar>::end(), payload,
+				payload + size);
+	}
+}
+
+inline void MidiMessage::clearPayloadView(void) {
+	m_payload     = NULL;
+	m_payloadsize = 0;
+}
+
+
 std::ostream& operator<<(std::ostream& out, MidiMessage& event);
 
 
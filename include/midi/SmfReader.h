@@ -0,0 +1,337 @@
+//
+// Creation Date: Mon Oct 19 16:40:27 PDT 2026
+// Filename:      midifile/include/SmfReader.h
+// Website:       http://midifile.sapp.org
+// Syntax:        C++17
+// vim:           ts=3 noexpandtab
+//
+// Description:   Walker for the header and track chunks of Standard MIDI
+//                Files, which is shared by MidiFile::read(), MidiFile::scan()
+//                and MidiFileSet.  It checks the structure of the data (VLV
+//                delta times, running status, meta and system-exclusive
+//                lengths, end of track) and passes each message of a track
+//                to a callback, so that the readers only need to handle
+//                the messages.  The functions are inline since they are
+//                called for every event that is read.
+//
+
+#ifndef _SMFREADER_H_INCLUDED
+#define _SMFREADER_H_INCLUDED
+
+#include "Vlv.h"
+
+#include <cstddef>
+
+namespace smf {
+
+
+// SmfHeader == Contents of the MThd chunk of a Standard MIDI File.
+class SmfHeader {
+	public:
+		int           type     = 0;   // 0 or 1
+		int           tracks   = 0;   // number of track chunks
+		int           division = 0;   // ticks per quarter note, or SMPTE timing
+
+		int           getTicksPerQuarterNote (void) const;
+};
+
+
+// SmfMessage == One message of a track chunk.  The bytes are not copied:
+// data points into the input, to the data bytes of channel messages or to
+// the payload of meta and system-exclusive messages.
+class SmfMessage {
+	public:
+		int           tick;       // absolute tick (sum of the delta times)
+		uchar         command;    // command byte (filled in for running status)
+		uchar         metatype;   // type of meta messages (0 for others)
+		const uchar*  length;     // VLV length of meta and system-exclusive
+		                          // messages, which ends at data (else NULL)
+		const uchar*  data;
+		int           size;       // number of bytes at data
+
+		bool          isMeta         (void) const;
+		bool          isEndOfTrack   (void) const;
+};
+
+
+class SmfReader {
+	public:
+		// Return values of the reading functions:
+		enum {
+			SMF_OK = 0,
+			SMF_STOPPED,              // callback returned false
+			SMF_END_OF_DATA,          // data ends before the end of track
+			SMF_BAD_CHUNK,            // missing MThd or MTrk chunk ID
+			SMF_BAD_HEADER,           // header chunk is not 6 bytes long
+			SMF_BAD_TYPE,             // type 2, or type 0 with several tracks
+			SMF_BAD_VLV,              // VLV longer than 4 bytes
+			SMF_BAD_RUNNING_STATUS,   // data byte without a channel command
+			SMF_BAD_DATA_BYTE         // channel message data byte over 0x7f
+		};
+
+		static int    readHeader     (const uchar*& ptr, const uchar* end,
+		                              SmfHeader& header);
+		static int    readTrackStart (const uchar*& ptr, const uchar* end,
+		                              ulong& chunksize);
+		template <class Callback>
+		static int    readTrack      (const uchar*& ptr, const uchar* end,
+		                              Callback callback);
+		static const char* getErrorMessage (int status);
+
+	private:
+		static bool   isChunkId      (const uchar* ptr, const uchar* end,
+		                              const char* id);
+		static int    readVlv        (const uchar*& ptr, const uchar* end,
+		                              ulong& value);
+};
+
+
+
+//////////////////////////////
+//
+// SmfHeader::getTicksPerQuarterNote -- Return the ticks per quarter note,
+//     or the ticks per second for SMPTE timing (frames per second times
+//     subframes).
+//
+
+inline int SmfHeader::getTicksPerQuarterNote(void) const {
+	if (division < 0x8000) {
+		return division;
+	}
+	int framespersecond = 255 - ((division >> 8) & 0x00ff) + 1;
+	return framespersecond * (division & 0x00ff);
+}
+
+
+
+//////////////////////////////
+//
+// SmfMessage::isMeta -- Returns true for meta messages.
+//
+
+inline bool SmfMessage::isMeta(void) const {
+	return command == 0xff;
+}
+
+
+
+//////////////////////////////
+//
+// SmfMessage::isEndOfTrack -- Returns true for the end-of-track message.
+//
+
+inline bool SmfMessage::isEndOfTrack(void) const {
+	return (command == 0xff) && (metatype == 0x2f);
+}
+
+
+
+//////////////////////////////
+//
+// SmfReader::readHeader -- Read the MThd chunk at the start of a Standard
+//     MIDI File and advance past it.  Only type-0 files with one track
+//     and type-1 files are accepted.
+//
+
+inline int SmfReader::readHeader(const uchar*& ptr, const uchar* end,
+		SmfHeader& header) {
+	if (!isChunkId(ptr, end, "MThd")) {
+		return end - ptr < 4 ? SMF_END_OF_DATA : SMF_BAD_CHUNK;
+	}
+	if (end - ptr < 14) {
+		return SMF_END_OF_DATA;
+	}
+	ulong headersize = ((ulong)ptr[4] << 24) | (ptr[5] << 16) | (ptr[6] << 8) |
+	                   ptr[7];
+	if (headersize != 6) {
+		return SMF_BAD_HEADER;
+	}
+	header.type     = (ptr[8]  << 8) | ptr[9];
+	header.tracks   = (ptr[10] << 8) | ptr[11];
+	header.division = (ptr[12] << 8) | ptr[13];
+	if ((header.type > 1) || ((header.type == 0) && (header.tracks != 1))) {
+		return SMF_BAD_TYPE;
+	}
+	ptr += 14;
+	return SMF_OK;
+}
+
+
+
+//////////////////////////////
+//
+// SmfReader::readTrackStart -- Read the ID and size of an MTrk chunk and
+//     advance to its first event.  The size does not need to be used,
+//     since the track ends at the end-of-track meta message, and many
+//     MIDI files found in the wild do not correctly give the track size.
+//
+
+inline int SmfReader::readTrackStart(const uchar*& ptr, const uchar* end,
+		ulong& chunksize) {
+	if (!isChunkId(ptr, end, "MTrk")) {
+		return end - ptr < 4 ? SMF_END_OF_DATA : SMF_BAD_CHUNK;
+	}
+	if (end - ptr < 8) {
+		return SMF_END_OF_DATA;
+	}
+	chunksize = ((ulong)ptr[4] << 24) | (ptr[5] << 16) | (ptr[6] << 8) | ptr[7];
+	ptr += 8;
+	return SMF_OK;
+}
+
+
+
+//////////////////////////////
+//
+// SmfReader::readTrack -- Read the events of a track chunk, up to and
+//     including the end-of-track message, and call callback(message) for
+//     each of them with an SmfMessage.  Reading stops (returning
+//     SMF_STOPPED) if the callback returns false.  Otherwise ptr is left
+//     after the end-of-track message and SMF_OK is returned, or an error
+//     code if the data is malformed, in which case the messages before
+//     the error have been passed to the callback.
+//
+
+template <class Callback>
+inline int SmfReader::readTrack(const uchar*& ptr, const uchar* end,
+		Callback callback) {
+	SmfMessage message;
+	message.tick = 0;
+	uchar runningCommand = 0;
+	ulong value = 0;
+	while (true) {
+		int status = readVlv(ptr, end, value);
+		if (status != SMF_OK) {
+			return status;
+		}
+		message.tick += (int)value;
+
+		// command byte, or first data byte of a running-status message:
+		if (ptr >= end) {
+			return SMF_END_OF_DATA;
+		}
+		if (*ptr >= 0x80) {
+			runningCommand = *ptr++;
+		} else if ((runningCommand == 0) || (runningCommand >= 0xf0)) {
+			// meta and sysex messages cannot be used for running status
+			return SMF_BAD_RUNNING_STATUS;
+		}
+		message.command  = runningCommand;
+		message.metatype = 0;
+		message.length   = NULL;
+		message.data     = ptr;
+		message.size     = 0;
+
+		switch (runningCommand & 0xf0) {
+			case 0x80: case 0x90: case 0xA0: case 0xB0: case 0xE0:
+				message.size = 2;
+				break;
+			case 0xC0: case 0xD0:
+				message.size = 1;
+				break;
+		}
+		if (message.size > 0) {
+			if (end - ptr < message.size) {
+				return SMF_END_OF_DATA;
+			}
+			if ((ptr[0] | ptr[message.size-1]) & 0x80) {
+				return SMF_BAD_DATA_BYTE;
+			}
+			ptr += message.size;
+		} else if ((runningCommand == 0xff) || (runningCommand == 0xf0) ||
+				(runningCommand == 0xf7)) {
+			if (runningCommand == 0xff) {
+				if (ptr >= end) {
+					return SMF_END_OF_DATA;
+				}
+				message.metatype = *ptr++;
+			}
+			message.length = ptr;
+			status = readVlv(ptr, end, value);
+			if (status != SMF_OK) {
+				return status;
+			}
+			if ((ulong)(end - ptr) < value) {
+				return SMF_END_OF_DATA;
+			}
+			message.data = ptr;
+			message.size = (int)value;
+			ptr += value;
+		}
+		// (other system messages do not have data bytes)
+
+		if (!callback(message)) {
+			return SMF_STOPPED;
+		}
+		if (message.isEndOfTrack()) {
+			return SMF_OK;
+		}
+	}
+}
+
+
+
+//////////////////////////////
+//
+// SmfReader::getErrorMessage -- Return a description of a return value
+//     of the reading functions.
+//
+
+inline const char* SmfReader::getErrorMessage(int status) {
+	switch (status) {
+		case SMF_OK:                 return "no error";
+		case SMF_STOPPED:            return "reading stopped";
+		case SMF_END_OF_DATA:        return "unexpected end of file";
+		case SMF_BAD_CHUNK:          return "data is not a Standard MIDI File";
+		case SMF_BAD_HEADER:         return "header chunk is not 6 bytes long";
+		case SMF_BAD_TYPE:           return "only type-0 MIDI files with one "
+		                                    "track and type-1 MIDI files can be read";
+		case SMF_BAD_VLV:            return "VLV number is too large";
+		case SMF_BAD_RUNNING_STATUS: return "running status without a previous "
+		                                    "channel message";
+		case SMF_BAD_DATA_BYTE:      return "MIDI data byte too large";
+	}
+	return "unknown error";
+}
+
+
+
+//////////////////////////////
+//
+// SmfReader::isChunkId -- Returns true if the data starts with the given
+//     four-character chunk ID.
+//
+
+inline bool SmfReader::isChunkId(const uchar* ptr, const uchar* end,
+		const char* id) {
+	if (end - ptr < 4) {
+		return false;
+	}
+	return (ptr[0] == (uchar)id[0]) && (ptr[1] == (uchar)id[1]) &&
+	       (ptr[2] == (uchar)id[2]) && (ptr[3] == (uchar)id[3]);
+}
+
+
+
+//////////////////////////////
+//
+// SmfReader::readVlv -- Read a VLV and advance past it.
+//
+
+inline int SmfReader::readVlv(const uchar*& ptr, const uchar* end,
+		ulong& value) {
+	int count = Vlv::decode(ptr, end - ptr, value);
+	if (count == 0) {
+		return end - ptr < Vlv::maxBytes ? SMF_END_OF_DATA : SMF_BAD_VLV;
+	}
+	ptr += count;
+	return SMF_OK;
+}
+
+
+} // end of namespace smf
+
+#endif /* _SMFREADER_H_INCLUDED */
+
+
+
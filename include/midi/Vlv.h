@@ -0,0 +1,136 @@
+//
+// Creation Date: Mon Oct 19 10:12:45 PDT 2026
+// Filename:      midifile/include/Vlv.h
+// Website:       http://midifile.sapp.org
+// Syntax:        C++17
+// vim:           ts=3 noexpandtab
+//
+// Description:   Decoder and encoder for the Variable-Length Values (VLVs)
+//                which store delta times and data lengths in Standard MIDI
+//                Files.  The functions work on byte spans and are inline
+//                since they are called for every event that is read or
+//                written.
+//
+
+#ifndef _VLV_H_INCLUDED
+#define _VLV_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+namespace smf {
+
+typedef unsigned char  uchar;
+typedef unsigned long  ulong;
+
+class Vlv {
+	public:
+		// Largest VLV allowed in a Standard MIDI File (0x0fffffff).
+		static const int maxBytes = 4;
+
+		static int     decode        (const uchar* data, size_t size,
+		                              ulong& value);
+		static int     encode        (ulong value, uchar* buffer);
+		static int     length        (ulong value);
+
+	private:
+		static int     highBit       (uint32_t value);
+};
+
+
+
+//////////////////////////////
+//
+// Vlv::decode -- Read a VLV from the start of the given bytes.  Returns
+//     the number of bytes in the VLV (1 to 4), or 0 if the data ends before
+//     the last byte of the VLV or if the VLV is longer than 4 bytes.  When
+//     at least 4 bytes are available, they are loaded as one big-endian
+//     word, and the length is found from the position of the first byte
+//     without a continuation bit instead of testing each byte.
+//
+
+inline int Vlv::decode(const uchar* data, size_t size, ulong& value) {
+	if (size < 4) {
+		ulong output = 0;
+		for (int i=0; i<(int)size; i++) {
+			output = (output << 7) | (data[i] & 0x7f);
+			if (data[i] < 0x80) {
+				value = output;
+				return i + 1;
+			}
+		}
+		return 0;
+	}
+
+	uint32_t word = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+	                ((uint32_t)data[2] <<  8) |  (uint32_t)data[3];
+	uint32_t last = ~word & 0x80808080u;
+	if (last == 0) {
+		// continuation bit on all four bytes
+		return 0;
+	}
+	int count = 4 - (highBit(last) >> 3);
+	word >>= (4 - count) * 8;
+	value = (word & 0x7f) | ((word >> 1) & 0x3f80) | ((word >> 2) & 0x1fc000) |
+	        ((word >> 3) & 0xfe00000);
+	return count;
+}
+
+
+
+//////////////////////////////
+//
+// Vlv::encode -- Write the VLV for a value into a buffer which must have
+//     room for 5 bytes (values up to 0xffffffff).  Returns the number of
+//     bytes written.
+//
+
+inline int Vlv::encode(ulong value, uchar* buffer) {
+	value &= 0xffffffffUL;
+	int count = length(value);
+	for (int i=0; i<count-1; i++) {
+		buffer[i] = (uchar)(((value >> (7 * (count - 1 - i))) & 0x7f) | 0x80);
+	}
+	buffer[count-1] = (uchar)(value & 0x7f);
+	return count;
+}
+
+
+
+//////////////////////////////
+//
+// Vlv::length -- Return the number of bytes needed to store a value as a
+//     VLV (1 to 5 bytes for values up to 0xffffffff).
+//
+
+inline int Vlv::length(ulong value) {
+	return highBit((uint32_t)value | 1) / 7 + 1;
+}
+
+
+
+//////////////////////////////
+//
+// Vlv::highBit -- Return the index of the highest set bit in a non-zero
+//     value (0 for the least significant bit).
+//
+
+inline int Vlv::highBit(uint32_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+	return 31 - __builtin_clz(value);
+#else
+	int output = 0;
+	while (value >>= 1) {
+		output++;
+	}
+	return output;
+#endif
+}
+
+
+} // end of namespace smf
+
+#endif /* _VLV_H_INCLUDED */
+
+
+
@@ -2,6 +2,8 @@
 
 #include "midi.hpp"
 
+#include "MidiEventColumns.h"
+
 // Constructor to init maps
 MIDIHandler::MIDIHandler() {
   init_maps();
@@ -12,7 +14,6 @@ MIDIHandler::~MIDIHandler() {}
 
 // Read a MIDI file
 std::vector < std::vector < std::string > > MIDIHandler::read_midi_file(const std::string & file_name) {
-  std::vector < MidiEvent > events;
   midifile.read(file_name);
   if (!midifile.status()) {
     throw std::runtime_error("Could not read MIDI file: " + file_name);
@@ -27,42 +28,45 @@ std::vector < std::vector < std::string > > MIDIHandler::read_midi_file(const st
 
   int tpq = midifile.getTicksPerQuarterNote();
 
-  // Loop through each event in the vector of events
+  // Find the note-on events of all tracks in one scan of the event columns
+  MidiEventColumns columns(midifile);
+  std::vector < int > rows;
+  columns.getNoteOnRows(rows);
+  const int * ticks = columns.getTicks();
+  const uchar * keys = columns.getData1();
+  size_t next = 0;
 
-  for (int track = 0; track < midifile.getTrackCount(); track++) {
-    for (int event = 0; event < midifile[track].size(); event++) {
-      MidiEvent mev = midifile[track][event];
+  // Loop through the note-on events of each track
 
+  for (int track = 0; track < midifile.getTrackCount(); track++) {
+    int track_end = columns.getTrackEnd(track);
+    for (; next < rows.size() && rows[next] < track_end; next++) {
       // Get the tick of the event
-      int tick = mev.tick;
-
-      // Check if the event is a note on channel event
-      if (mev.isNoteOn()) {
-        // Convert the byte of the event to a note name using the midi handler object
-        std::string note = byte_to_note(mev[1]);
-
-        // Time difference between the current event and the previous event
-        int delta_time = abs(tick - prev_tick);
-
-        // Threshold based on the tempo of the MIDI file
-        int threshold = tpq * 0.01;
-
-        // Check if previous event's tick is equal or close enough to the current event's tick
-        if (prev_tick == -1 || delta_time < threshold) {
-          // Concatenate the note name to the current note or chord
-          current.push_back(note);
-        } else {
-          // Add the current note or chord to the vector
-          notes_or_chords.push_back(current);
-          // Start a new note or chord with the current note name
-          current.clear();
-          current.push_back(note);
-        }
-
-        // Replace previous event's tick with the current event's tick
-        prev_tick = tick;
+      int tick = ticks[rows[next]];
+
+      // Convert the key byte of the note on event to a note name using the midi handler object
+      std::string note = byte_to_note(keys[rows[next]]);
+
+      // Time difference between the current event and the previous event
+      int delta_time = abs(tick - prev_tick);
+
+      // Threshold based on the tempo of the MIDI file
+      int threshold = tpq * 0.01;
+
+      // Check if previous event's tick is equal or close enough to the current event's tick
+      if (prev_tick == -1 || delta_time < threshold) {
+        // Concatenate the note name to the current note or chord
+        current.push_back(note);
+      } else {
+        // Add the current note or chord to the vector
+        notes_or_chords.push_back(current);
+        // Start a new note or chord with the current note name
+        current.clear();
+        current.push_back(note);
       }
 
+      // Replace previous event's tick with the current event's tick
+      prev_tick = tick;
     }
     notes_or_chords.push_back(current);
 
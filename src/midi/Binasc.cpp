@@ -3,13 +3,14 @@
 // Creation Date: Mon Feb 16 12:26:32 PST 2015 Adapted from binasc program.
 // Last Modified: Sat Apr 21 10:52:19 PDT 2018 Removed using namespace std;
 // Filename:      midifile/src/Binasc.cpp
-// Syntax:        C++11
+// Syntax:        C++17
 // vim:           ts=3 noexpandtab
 //
 // description:   Interface to convert bytes between binary and ASCII forms.
 //
 
 #include "Binasc.h"
+#include "Vlv.h"
 
 #include <sstream>
 #include <stdlib.h>
@@ -633,17 +634,22 @@ int Binasc::getWord(std::string& word, const std::string& input,
 //
 
 int Binasc::getVLV(std::istream& infile, int& trackbytes) {
-	int output = 0;
-	uchar ch = 0;
-	infile.read((char*)&ch, 1);
-	trackbytes++;
-	output = (output << 7) | (0x7f & ch);
-	while (ch >= 0x80) {
-		infile.read((char*)&ch, 1);
+	uchar bytes[Vlv::maxBytes];
+	int count = 0;
+	while (count < Vlv::maxBytes) {
+		int ch = infile.get();
+		if (ch == EOF) {
+			break;
+		}
 		trackbytes++;
-		output = (output << 7) | (0x7f & ch);
+		bytes[count++] = (uchar)ch;
+		if (ch < 0x80) {
+			break;
+		}
 	}
-	return output;
+	ulong output = 0;
+	Vlv::decode(bytes, count, output);
+	return (int)output;
 }
 
 
@@ -1688,29 +1694,9 @@ int Binasc::processVlvWord(std::ostream& out, const std::string& word,
 	}
 	ulong value = atoi(&word[1]);
 
-	uchar byte[5];
-	byte[0] = (value >> 28) & 0x7f;
-	byte[1] = (value >> 21) & 0x7f;
-	byte[2] = (value >> 14) & 0x7f;
-	byte[3] = (value >>  7) & 0x7f;
-	byte[4] = (value >>  0) & 0x7f;
-
-	int i;
-	int flag = 0;
-	for (i=0; i<4; i++) {
-		if (byte[i] != 0) {
-			flag = 1;
-		}
-		if (flag) {
-			byte[i] |= 0x80;
-		}
-	}
-
-	for (i=0; i<5; i++) {
-		if (byte[i] >= 0x80 || i == 4) {
-			out << byte[i];
-		}
-	}
+	uchar bytes[5];
+	int count = Vlv::encode(value, bytes);
+	out.write((char*)bytes, count);
 
 	return 1;
 }
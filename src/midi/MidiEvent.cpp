@@ -4,7 +4,7 @@
 // Last Modified: Sat Apr 21 10:52:19 PDT 2018 Removed using namespace std;
 // Filename:      midifile/src/MidiEvent.cpp
 // Website:       http://midifile.sapp.org
-// Syntax:        C++11
+// Syntax:        C++17
 // vim:           ts=3 noexpandtab
 //
 // Description:   A class which stores a MidiMessage and a timestamp
@@ -54,16 +54,32 @@ MidiEvent::MidiEvent(int aTime, int aTrack, vector<uchar>& message)
 }
 
 
-MidiEvent::MidiEvent(const MidiEvent& mfevent) : MidiMessage() {
+MidiEvent::MidiEvent(const MidiEvent& mfevent) : MidiMessage(mfevent) {
 	track   = mfevent.track;
 	tick    = mfevent.tick;
 	seconds = mfevent.seconds;
 	seq     = mfevent.seq;
 	m_eventlink = NULL;
+}
+
+
+
+//
+// Move constructor: the message bytes and any payload view are taken over
+// from the other event, as is its link, so that the linked event points
+// to the new location of this event.
+//
 
-	this->resize(mfevent.size());
-	for (int i=0; i<(int)this->size(); i++) {
-		(*this)[i] = mfevent[i];
+MidiEvent::MidiEvent(MidiEvent&& mfevent) noexcept : MidiMessage() {
+	track   = mfevent.track;
+	tick    = mfevent.tick;
+	seconds = mfevent.seconds;
+	seq     = mfevent.seq;
+	this->swap(mfevent);
+	m_eventlink = mfevent.m_eventlink;
+	mfevent.m_eventlink = NULL;
+	if (m_eventlink != NULL) {
+		m_eventlink->m_eventlink = this;
 	}
 }
 
@@ -79,7 +95,7 @@ MidiEvent::~MidiEvent() {
 	tick    = -1;
 	seconds = -1.0;
 	seq     = -1;
-	this->resize(0);
+	this->clear();
 	m_eventlink = NULL;
 }
 
@@ -112,10 +128,7 @@ MidiEvent& MidiEvent::operator=(const MidiEvent& mfevent) {
 	seconds = mfevent.seconds;
 	seq     = mfevent.seq;
 	m_eventlink = NULL;
-	this->resize(mfevent.size());
-	for (int i=0; i<(int)this->size(); i++) {
-		(*this)[i] = mfevent[i];
-	}
+	MidiMessage::operator=(mfevent);
 	return *this;
 }
 
@@ -125,20 +138,14 @@ MidiEvent& MidiEvent::operator=(const MidiMessage& message) {
 		return *this;
 	}
 	clearVariables();
-	this->resize(message.size());
-	for (int i=0; i<(int)this->size(); i++) {
-		(*this)[i] = message[i];
-	}
+	MidiMessage::operator=(message);
 	return *this;
 }
 
 
 MidiEvent& MidiEvent::operator=(const vector<uchar>& bytes) {
 	clearVariables();
-	this->resize(bytes.size());
-	for (int i=0; i<(int)this->size(); i++) {
-		(*this)[i] = bytes[i];
-	}
+	setMessage(bytes);
 	return *this;
 }
 
@@ -0,0 +1,675 @@
+//
+// Creation Date: Mon Oct 19 17:26:40 PDT 2026
+// Filename:      midifile/src/MidiEventColumns.cpp
+// Website:       http://midifile.sapp.org
+// Syntax:        C++17
+// vim:           ts=3 noexpandtab
+//
+// Description:   A columnar copy of the events in a MidiFile: one array
+//                for each field (tick, track, status byte, two data bytes
+//                and the index of the event in its track), so that analysis
+//                passes can scan plain arrays instead of MidiEvent objects.
+//                The columns are a snapshot of the file, and they must be
+//                rebuilt with build() after the events are changed.  Common
+//                scans (note-on counts, pitch histogram, onsets and tick
+//                ranges) are vectorized, with the instruction set chosen
+//                at runtime.
+//
+
+#include "MidiEventColumns.h"
+
+#include <atomic>
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+		(defined(__x86_64__) || defined(__i386__))
+	#define MIDIEVENTCOLUMNS_X86
+	#include <immintrin.h>
+#endif
+
+
+namespace smf {
+
+//////////////////////////////
+//
+// Scan kernels -- Each scan has a scalar version and, on x86 processors,
+//     SSE2 and AVX2 versions which test 16 or 32 rows at a time.  A row is
+//     a note-on if its command nibble is 0x90 and its velocity is not 0 (as
+//     in MidiMessage::isNoteOn()).  The kernels write to output arrays which
+//     have room for one entry per row and return the number of entries.
+//
+
+static void countNoteOnsScalar(const uchar* status, const uchar* data2,
+		int start, int end, int* counts) {
+	for (int i=start; i<end; i++) {
+		if (((status[i] & 0xf0) == 0x90) && data2[i]) {
+			counts[status[i] & 0x0f]++;
+		}
+	}
+}
+
+
+static void pitchHistogramScalar(const uchar* status, const uchar* data1,
+		const uchar* data2, int start, int end, int* histogram) {
+	for (int i=start; i<end; i++) {
+		if (((status[i] & 0xf0) == 0x90) && data2[i] && (data1[i] < 128)) {
+			histogram[data1[i]]++;
+		}
+	}
+}
+
+
+static int noteOnRowsScalar(const uchar* status, const uchar* data2,
+		int start, int end, int* rows) {
+	int count = 0;
+	for (int i=start; i<end; i++) {
+		rows[count] = i;
+		count += ((status[i] & 0xf0) == 0x90) && data2[i];
+	}
+	return count;
+}
+
+
+static int tickRangeRowsScalar(const int* ticks, int starttick, int endtick,
+		int start, int end, int* rows) {
+	int count = 0;
+	for (int i=start; i<end; i++) {
+		rows[count] = i;
+		count += (ticks[i] >= starttick) && (ticks[i] < endtick);
+	}
+	return count;
+}
+
+
+#ifdef MIDIEVENTCOLUMNS_X86
+
+// Write the row numbers of the set bits of a mask to the output.
+static inline int appendMaskRows(unsigned int mask, int row, int* rows) {
+	int count = 0;
+	while (mask) {
+		rows[count++] = row + __builtin_ctz(mask);
+		mask &= mask - 1;
+	}
+	return count;
+}
+
+
+__attribute__((target("sse2")))
+static inline __m128i noteOnMaskSse2(const uchar* status, const uchar* data2) {
+	__m128i s = _mm_loadu_si128((const __m128i*)status);
+	__m128i v = _mm_loadu_si128((const __m128i*)data2);
+	__m128i on = _mm_cmpeq_epi8(_mm_and_si128(s, _mm_set1_epi8((char)0xf0)),
+			_mm_set1_epi8((char)0x90));
+	return _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()), on);
+}
+
+
+__attribute__((target("avx2")))
+static inline __m256i noteOnMaskAvx2(const uchar* status, const uchar* data2) {
+	__m256i s = _mm256_loadu_si256((const __m256i*)status);
+	__m256i v = _mm256_loadu_si256((const __m256i*)data2);
+	__m256i on = _mm256_cmpeq_epi8(_mm256_and_si256(s,
+			_mm256_set1_epi8((char)0xf0)), _mm256_set1_epi8((char)0x90));
+	return _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()), on);
+}
+
+
+// Channels are counted in 8-bit lanes (one counter register per channel),
+// which are added into the output before they can overflow.
+__attribute__((target("sse2")))
+static void countNoteOnsSse2(const uchar* status, const uchar* data2,
+		int size, int* counts) {
+	int i = 0;
+	while (i + 16 <= size) {
+		__m128i acc[16];
+		for (int c=0; c<16; c++) {
+			acc[c] = _mm_setzero_si128();
+		}
+		for (int k=0; (k<255) && (i+16<=size); k++, i+=16) {
+			__m128i s = _mm_and_si128(noteOnMaskSse2(status + i, data2 + i),
+					_mm_loadu_si128((const __m128i*)(status + i)));
+			for (int c=0; c<16; c++) {
+				acc[c] = _mm_sub_epi8(acc[c], _mm_cmpeq_epi8(s,
+						_mm_set1_epi8((char)(0x90 + c))));
+			}
+		}
+		for (int c=0; c<16; c++) {
+			__m128i sum = _mm_sad_epu8(acc[c], _mm_setzero_si128());
+			counts[c] += _mm_cvtsi128_si32(sum) +
+					_mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+		}
+	}
+	countNoteOnsScalar(status, data2, i, size, counts);
+}
+
+
+__attribute__((target("avx2")))
+static void countNoteOnsAvx2(const uchar* status, const uchar* data2,
+		int size, int* counts) {
+	int i = 0;
+	while (i + 32 <= size) {
+		__m256i acc[16];
+		for (int c=0; c<16; c++) {
+			acc[c] = _mm256_setzero_si256();
+		}
+		for (int k=0; (k<255) && (i+32<=size); k++, i+=32) {
+			__m256i s = _mm256_and_si256(noteOnMaskAvx2(status + i, data2 + i),
+					_mm256_loadu_si256((const __m256i*)(status + i)));
+			for (int c=0; c<16; c++) {
+				acc[c] = _mm256_sub_epi8(acc[c], _mm256_cmpeq_epi8(s,
+						_mm256_set1_epi8((char)(0x90 + c))));
+			}
+		}
+		for (int c=0; c<16; c++) {
+			__m256i sum = _mm256_sad_epu8(acc[c], _mm256_setzero_si256());
+			counts[c] += _mm256_extract_epi32(sum, 0) +
+					_mm256_extract_epi32(sum, 2) + _mm256_extract_epi32(sum, 4) +
+					_mm256_extract_epi32(sum, 6);
+		}
+	}
+	countNoteOnsScalar(status, data2, i, size, counts);
+}
+
+
+// Histogram bins are updated one note at a time, but the vector mask
+// skips over the rows which are not note-ons.
+__attribute__((target("sse2")))
+static void pitchHistogramSse2(const uchar* status, const uchar* data1,
+		const uchar* data2, int size, int* histogram) {
+	int i = 0;
+	for ( ; i+16<=size; i+=16) {
+		unsigned int mask = _mm_movemask_epi8(noteOnMaskSse2(status + i,
+				data2 + i));
+		mask &= ~_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(data1 + i)));
+		while (mask) {
+			histogram[data1[i + __builtin_ctz(mask)]]++;
+			mask &= mask - 1;
+		}
+	}
+	pitchHistogramScalar(status, data1, data2, i, size, histogram);
+}
+
+
+__attribute__((target("avx2")))
+static void pitchHistogramAvx2(const uchar* status, const uchar* data1,
+		const uchar* data2, int size, int* histogram) {
+	int i = 0;
+	for ( ; i+32<=size; i+=32) {
+		unsigned int mask = _mm256_movemask_epi8(noteOnMaskAvx2(status + i,
+				data2 + i));
+		mask &= ~_mm256_movemask_epi8(_mm256_loadu_si256(
+				(const __m256i*)(data1 + i)));
+		while (mask) {
+			histogram[data1[i + __builtin_ctz(mask)]]++;
+			mask &= mask - 1;
+		}
+	}
+	pitchHistogramScalar(status, data1, data2, i, size, histogram);
+}
+
+
+__attribute__((target("sse2")))
+static int noteOnRowsSse2(const uchar* status, const uchar* data2, int size,
+		int* rows) {
+	int i = 0;
+	int count = 0;
+	for ( ; i+16<=size; i+=16) {
+		unsigned int mask = _mm_movemask_epi8(noteOnMaskSse2(status + i,
+				data2 + i));
+		count += appendMaskRows(mask, i, rows + count);
+	}
+	return count + noteOnRowsScalar(status, data2, i, size, rows + count);
+}
+
+
+__attribute__((target("avx2")))
+static int noteOnRowsAvx2(const uchar* status, const uchar* data2, int size,
+		int* rows) {
+	int i = 0;
+	int count = 0;
+	for ( ; i+32<=size; i+=32) {
+		unsigned int mask = _mm256_movemask_epi8(noteOnMaskAvx2(status + i,
+				data2 + i));
+		count += appendMaskRows(mask, i, rows + count);
+	}
+	return count + noteOnRowsScalar(status, data2, i, size, rows + count);
+}
+
+
+__attribute__((target("sse2")))
+static int tickRangeRowsSse2(const int* ticks, int starttick, int endtick,
+		int size, int* rows) {
+	__m128i lower = _mm_set1_epi32(starttick);
+	__m128i upper = _mm_set1_epi32(endtick);
+	int i = 0;
+	int count = 0;
+	for ( ; i+4<=size; i+=4) {
+		__m128i t = _mm_loadu_si128((const __m128i*)(ticks + i));
+		__m128i in = _mm_andnot_si128(_mm_cmpgt_epi32(lower, t),
+				_mm_cmpgt_epi32(upper, t));
+		unsigned int mask = _mm_movemask_ps(_mm_castsi128_ps(in));
+		count += appendMaskRows(mask, i, rows + count);
+	}
+	return count + tickRangeRowsScalar(ticks, starttick, endtick, i, size,
+			rows + count);
+}
+
+
+__attribute__((target("avx2")))
+static int tickRangeRowsAvx2(const int* ticks, int starttick, int endtick,
+		int size, int* rows) {
+	__m256i lower = _mm256_set1_epi32(starttick);
+	__m256i upper = _mm256_set1_epi32(endtick);
+	int i = 0;
+	int count = 0;
+	for ( ; i+8<=size; i+=8) {
+		__m256i t = _mm256_loadu_si256((const __m256i*)(ticks + i));
+		__m256i in = _mm256_andnot_si256(_mm256_cmpgt_epi32(lower, t),
+				_mm256_cmpgt_epi32(upper, t));
+		unsigned int mask = _mm256_movemask_ps(_mm256_castsi256_ps(in));
+		count += appendMaskRows(mask, i, rows + count);
+	}
+	return count + tickRangeRowsScalar(ticks, starttick, endtick, i, size,
+			rows + count);
+}
+
+#endif  /* MIDIEVENTCOLUMNS_X86 */
+
+
+
+//////////////////////////////
+//
+// getSupportedSimdLevel -- Return the best instruction set of the
+//     processor which is used by the scan kernels.
+//
+
+static int getSupportedSimdLevel(void) {
+#ifdef MIDIEVENTCOLUMNS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return 2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+static std::atomic<int> simdLevel(-1);
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::MidiEventColumns -- Constructor.
+//
+
+MidiEventColumns::MidiEventColumns(void) {
+	clear();
+}
+
+
+MidiEventColumns::MidiEventColumns(const MidiFile& midifile) {
+	build(midifile);
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::~MidiEventColumns -- Deconstructor.
+//
+
+MidiEventColumns::~MidiEventColumns() {
+	// do nothing
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::build -- Copy the events of a MidiFile into the
+//     columns, replacing any previous contents.  Events are stored track
+//     by track in the order of the event lists, so the tracks are only
+//     in time order if the MidiFile is sorted.
+//
+
+void MidiEventColumns::build(const MidiFile& midifile) {
+	int trackcount = midifile.getTrackCount();
+	m_trackstart.resize(trackcount + 1);
+	int total = 0;
+	for (int i=0; i<trackcount; i++) {
+		m_trackstart[i] = total;
+		total += midifile[i].size();
+	}
+	m_trackstart[trackcount] = total;
+
+	m_ticks.resize(total);
+	m_tracks.resize(total);
+	m_indexes.resize(total);
+	m_status.resize(total);
+	m_data1.resize(total);
+	m_data2.resize(total);
+
+	int row = 0;
+	for (int i=0; i<trackcount; i++) {
+		const MidiEventList& list = midifile[i];
+		int count = list.size();
+		for (int j=0; j<count; j++) {
+			const MidiEvent& event = list[j];
+			int length = (int)event.size();
+			m_ticks[row]   = event.tick;
+			m_tracks[row]  = i;
+			m_indexes[row] = j;
+			m_status[row]  = length > 0 ? event[0] : 0;
+			m_data1[row]   = length > 1 ? event[1] : 0;
+			m_data2[row]   = length > 2 ? event[2] : 0;
+			row++;
+		}
+	}
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::clear -- Remove all events.
+//
+
+void MidiEventColumns::clear(void) {
+	m_ticks.clear();
+	m_tracks.clear();
+	m_indexes.clear();
+	m_status.clear();
+	m_data1.clear();
+	m_data2.clear();
+	m_trackstart.assign(1, 0);
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::size -- Return the number of events in all tracks.
+//
+
+int MidiEventColumns::size(void) const {
+	return (int)m_ticks.size();
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::getTrackCount -- Return the number of tracks.
+//
+
+int MidiEventColumns::getTrackCount(void) const {
+	return (int)m_trackstart.size() - 1;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::getTrackStart -- Return the row of the first event
+//     in a track.  The events of the track are the rows from
+//     getTrackStart(track) to getTrackEnd(track)-1.
+//
+
+int MidiEventColumns::getTrackStart(int track) const {
+	return m_trackstart[track];
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::getTrackEnd -- Return the row after the last event
+//     in a track.
+//
+
+int MidiEventColumns::getTrackEnd(int track) const {
+	return m_trackstart[track + 1];
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::getTicks -- Return the tick column.
+//
+
+const int* MidiEventColumns::getTicks(void) const {
+	return m_ticks.data();
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::getTracks -- Return the track column.
+//
+
+const int* MidiEventColumns::getTracks(void) const {
+	return m_tracks.data();
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::getIndexes -- Return the column of event indexes
+//     within their tracks, so that a row can be mapped back to its
+//     MidiEvent with midifile[tracks[row]][indexes[row]].
+//
+
+const int* MidiEventColumns::getIndexes(void) const {
+	return m_indexes.data();
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::getStatus -- Return the column of status (command)
+//     bytes.
+//
+
+const uchar* MidiEventColumns::getStatus(void) const {
+	return m_status.data();
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::getData1 -- Return the column of first data bytes
+//     (key number, controller number, or meta type).
+//
+
+const uchar* MidiEventColumns::getData1(void) const {
+	return m_data1.data();
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::getData2 -- Return the column of second data bytes
+//     (velocity or controller value).
+//
+
+const uchar* MidiEventColumns::getData2(void) const {
+	return m_data2.data();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////
+//
+// scan functions --
+//
+
+//////////////////////////////
+//
+// MidiEventColumns::getNoteOnCounts -- Count the note-ons on each channel.
+//     The output has 16 entries, one for each channel.
+//
+
+void MidiEventColumns::getNoteOnCounts(std::vector<int>& counts) const {
+	counts.assign(16, 0);
+	const uchar* status = m_status.data();
+	const uchar* data2 = m_data2.data();
+	switch (getSimdLevel()) {
+#ifdef MIDIEVENTCOLUMNS_X86
+		case 2: countNoteOnsAvx2(status, data2, size(), counts.data()); break;
+		case 1: countNoteOnsSse2(status, data2, size(), counts.data()); break;
+#endif
+		default: countNoteOnsScalar(status, data2, 0, size(), counts.data());
+	}
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::getPitchHistogram -- Count the note-ons of each key
+//     number.  The output has 128 entries.
+//
+
+void MidiEventColumns::getPitchHistogram(std::vector<int>& histogram) const {
+	histogram.assign(128, 0);
+	const uchar* status = m_status.data();
+	const uchar* data1 = m_data1.data();
+	const uchar* data2 = m_data2.data();
+	switch (getSimdLevel()) {
+#ifdef MIDIEVENTCOLUMNS_X86
+		case 2:
+			pitchHistogramAvx2(status, data1, data2, size(), histogram.data());
+			break;
+		case 1:
+			pitchHistogramSse2(status, data1, data2, size(), histogram.data());
+			break;
+#endif
+		default:
+			pitchHistogramScalar(status, data1, data2, 0, size(),
+					histogram.data());
+	}
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::getNoteOnRows -- Return the rows of all note-ons, in
+//     row order.
+//
+
+void MidiEventColumns::getNoteOnRows(std::vector<int>& rows) const {
+	rows.resize(size());
+	const uchar* status = m_status.data();
+	const uchar* data2 = m_data2.data();
+	int count;
+	switch (getSimdLevel()) {
+#ifdef MIDIEVENTCOLUMNS_X86
+		case 2: count = noteOnRowsAvx2(status, data2, size(), rows.data()); break;
+		case 1: count = noteOnRowsSse2(status, data2, size(), rows.data()); break;
+#endif
+		default: count = noteOnRowsScalar(status, data2, 0, size(), rows.data());
+	}
+	rows.resize(count);
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::getOnsetTicks -- Return the tick of each note-on, in
+//     row order (so the ticks of each track are together).
+//
+
+void MidiEventColumns::getOnsetTicks(std::vector<int>& ticks) const {
+	getNoteOnRows(ticks);
+	const int* rowticks = m_ticks.data();
+	for (int i=0; i<(int)ticks.size(); i++) {
+		ticks[i] = rowticks[ticks[i]];
+	}
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::getRowsInTickRange -- Return the rows of all events
+//     with a tick from starttick up to (but not including) endtick.  The
+//     ticks do not need to be sorted.
+//
+
+void MidiEventColumns::getRowsInTickRange(int starttick, int endtick,
+		std::vector<int>& rows) const {
+	rows.resize(size());
+	const int* ticks = m_ticks.data();
+	int count;
+	switch (getSimdLevel()) {
+#ifdef MIDIEVENTCOLUMNS_X86
+		case 2:
+			count = tickRangeRowsAvx2(ticks, starttick, endtick, size(),
+					rows.data());
+			break;
+		case 1:
+			count = tickRangeRowsSse2(ticks, starttick, endtick, size(),
+					rows.data());
+			break;
+#endif
+		default:
+			count = tickRangeRowsScalar(ticks, starttick, endtick, 0, size(),
+					rows.data());
+	}
+	rows.resize(count);
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::getSimdLevel -- Return the instruction set used by
+//     the scan functions: 0 = scalar code, 1 = SSE2, 2 = AVX2.  The level
+//     is detected from the processor the first time it is needed.
+//
+
+int MidiEventColumns::getSimdLevel(void) {
+	int level = simdLevel.load(std::memory_order_relaxed);
+	if (level < 0) {
+		level = getSupportedSimdLevel();
+		simdLevel.store(level, std::memory_order_relaxed);
+	}
+	return level;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventColumns::setSimdLevel -- Limit the instruction set used by the
+//     scan functions (such as 0 to compare with the scalar code).  Levels
+//     which the processor does not support are lowered to the best one
+//     which it does.
+//
+
+void MidiEventColumns::setSimdLevel(int level) {
+	int supported = getSupportedSimdLevel();
+	if (level > supported) {
+		level = supported;
+	}
+	if (level < 0) {
+		level = 0;
+	}
+	simdLevel.store(level, std::memory_order_relaxed);
+}
+
+
+} // end namespace smf
+
+
+
@@ -4,7 +4,7 @@
 // Last Modified: Sat Apr 21 10:52:19 PDT 2018 Removed using namespace std;
 // Filename:      midifile/src/MidiEventList.cpp
 // Website:       http://midifile.sapp.org
-// Syntax:        C++11
+// Syntax:        C++17
 // vim:           ts=3 noexpandtab
 //
 // Description:   A class which stores a MidiEvents for a MidiFile track.
@@ -17,6 +17,8 @@
 #include <algorithm>
 #include <iterator>
 #include <utility>
+#include <functional>
+#include <memory>
 
 #include <stdlib.h>
 
@@ -28,7 +30,7 @@ namespace smf {
 //
 
 MidiEventList::MidiEventList(void) {
-	reserve(1000);
+	// do nothing
 }
 
 
@@ -39,11 +41,18 @@ MidiEventList::MidiEventList(void) {
 //
 
 MidiEventList::MidiEventList(const MidiEventList& other) {
+	if (other.list.empty()) {
+		return;
+	}
+	// The copies are stored in a single block, in list order.
+	auto block = std::make_shared<std::vector<MidiEvent>>();
+	block->reserve(other.list.size());
 	list.reserve(other.list.size());
-	auto it = other.list.begin();
-	std::generate_n(std::back_inserter(list), other.list.size(), [&]() -> MidiEvent* {
-		return new MidiEvent(**it++);
-	});
+	for (int i=0; i<(int)other.list.size(); i++) {
+		block->emplace_back(*other.list[i]);
+		list.push_back(&block->back());
+	}
+	addBlock(block);
 }
 
 
@@ -56,6 +65,12 @@ MidiEventList::MidiEventList(const MidiEventList& other) {
 MidiEventList::MidiEventList(MidiEventList&& other) {
    list = std::move(other.list);
    other.list.clear();
+   blocks = std::move(other.blocks);
+   other.blocks.clear();
+   fillblock = other.fillblock;
+   other.fillblock = NULL;
+   sortorder = other.sortorder;
+   other.sortorder = -1;
 }
 
 
@@ -142,12 +157,15 @@ const MidiEvent& MidiEventList::getEvent(int index) const {
 
 void MidiEventList::clear(void) {
 	for (int i=0; i<(int)list.size(); i++) {
-		if (list[i] != NULL) {
+		if ((list[i] != NULL) && !isBlockEvent(list[i])) {
 			delete list[i];
-			list[i] = NULL;
 		}
+		list[i] = NULL;
 	}
 	list.resize(0);
+	blocks.clear();
+	fillblock = NULL;
+	sortorder = -1;
 }
 
 
@@ -156,10 +174,12 @@ void MidiEventList::clear(void) {
 //
 // MidiEventList::data -- Return the low-level array of MidiMessage
 //     pointers.  This is useful for applying your own sorting
-//     function to the list.
+//     function to the list.  The order of the events is checked again
+//     by the next getTickRange().
 //
 
 MidiEvent** MidiEventList::data(void) {
+	sortorder = -1;
 	return list.data();
 }
 
@@ -215,6 +235,7 @@ int MidiEventList::getEventCount(void) const {
 int MidiEventList::append(MidiEvent& event) {
 	MidiEvent* ptr = new MidiEvent(event);
 	list.push_back(ptr);
+	sortorder = -1;
 	return (int)list.size()-1;
 }
 
@@ -236,6 +257,135 @@ int MidiEventList::push_back(MidiEvent& event) {
 
 
 
+//////////////////////////////
+//
+// MidiEventList::insertSorted -- Add a copy of a MidiEvent at its sorted
+//     position in the list, which is where sort() would place it after
+//     appending it (after any events with the same sorting order).  The
+//     list is sorted first if it is not sorted already, which is only
+//     checked again after the list has been changed in other ways, so a
+//     series of insertions does not need to sort the list (call
+//     clearTickIndex() after assigning ticks to the events directly).
+//     If the events in the list have sequence numbers (such as after
+//     reading a MIDI file) and the new event does not, the copy is placed
+//     after the events at the same tick and given the next sequence number
+//     after the event before it, so the list stays in the order of sort().
+//     Returns the index of the inserted event.  The events should be in
+//     absolute tick mode (see MidiFile::sortTracks()).
+//
+
+int MidiEventList::insertSorted(MidiEvent& event) {
+	int mode = prepareSortedInsert(event.seq != 0 ? 1 : 0);
+	if (mode < 0) {
+		// Inconsistent sequence numbers, so let sort() sort it out.
+		MidiEvent* ptr = new MidiEvent(event);
+		list.push_back(ptr);
+		sort();
+		return (int)(std::find(list.begin(), list.end(), ptr) - list.begin());
+	}
+	SortKey key = getSortKey(event, mode == 1, (int)list.size());
+	auto position = std::upper_bound(list.begin(), list.end(), key,
+		[mode](const SortKey& value, const MidiEvent* other) {
+			return isKeyBefore(value, *other, mode);
+		});
+	int index = (int)(position - list.begin());
+	MidiEvent* ptr = new MidiEvent(event);
+	if (mode == 2) {
+		ptr->seq = index > 0 ? list[index-1]->seq + 1 : 1;
+	}
+	list.insert(position, ptr);
+	return index;
+}
+
+
+//
+// MidiEventList::insertSorted -- Insert copies of a batch of MidiEvents
+//     at their sorted positions.  The batch is sorted by itself and then
+//     merged into the list in one pass, which gives the same order as
+//     appending the events and calling sort().  The copies are stored in
+//     the spare space of the current block of the list, or in a new block
+//     (with room for later batches as well) if it is too small.  Events
+//     without sequence numbers are given them as in the single event
+//     version, if the events in the list have them.  If track is not
+//     negative, the track of each copy is set to it.
+//
+
+void MidiEventList::insertSorted(const std::vector<MidiEvent>& events,
+		int track) {
+	if (events.empty()) {
+		return;
+	}
+	int seqstate = events[0].seq != 0 ? 1 : 0;
+	bool consistent = true;
+	for (int i=1; i<(int)events.size(); i++) {
+		if ((events[i].seq != 0) != (bool)seqstate) {
+			consistent = false;
+			break;
+		}
+	}
+
+	int spare = 0;
+	if (fillblock != NULL) {
+		spare = (int)(fillblock->capacity() - fillblock->size());
+	}
+	if (spare < (int)events.size()) {
+		reserveBlock(std::max((int)events.size(), (int)list.size()));
+	}
+	std::vector<MidiEvent*> added(events.size());
+	for (int i=0; i<(int)events.size(); i++) {
+		added[i] = newEvent();
+		*added[i] = events[i];
+		if (track >= 0) {
+			added[i]->track = track;
+		}
+	}
+
+	int mode = consistent ? prepareSortedInsert(seqstate) : -1;
+	if (mode < 0) {
+		// Inconsistent sequence numbers, so let sort() sort it out.
+		list.insert(list.end(), added.begin(), added.end());
+		sort();
+		return;
+	}
+
+	int count = (int)list.size();
+	std::vector<SortKey> keys(added.size());
+	for (int i=0; i<(int)added.size(); i++) {
+		keys[i] = getSortKey(*added[i], mode == 1, count + i);
+	}
+	std::sort(keys.begin(), keys.end());
+
+	// The position of each inserted event is found with a binary search
+	// in the rest of the list, and then the list is merged in place from
+	// the back, so that the list is not reallocated for each batch.
+	std::vector<int> positions(keys.size());
+	auto position = list.begin();
+	for (int j=0; j<(int)keys.size(); j++) {
+		position = std::upper_bound(position, list.end(), keys[j],
+			[mode](const SortKey& value, const MidiEvent* other) {
+				return isKeyBefore(value, *other, mode);
+			});
+		positions[j] = (int)(position - list.begin());
+	}
+	list.resize(count + keys.size());
+	int end = count;
+	for (int j=(int)keys.size()-1; j>=0; j--) {
+		std::move_backward(list.begin() + positions[j], list.begin() + end,
+				list.begin() + end + j + 1);
+		list[positions[j] + j] = added[keys[j].index - count];
+		end = positions[j];
+	}
+	if (mode == 2) {
+		// in list order, so that each event follows the one before it
+		for (int j=0; j<(int)keys.size(); j++) {
+			int index = positions[j] + j;
+			list[index]->seq = index > 0 ? list[index-1]->seq + 1 : 1;
+		}
+	}
+}
+
+
+
 //////////////////////////////
 //
 // MidiEventList::removeEmpties -- Remove any MIDI message which contain no
@@ -247,7 +397,9 @@ void MidiEventList::removeEmpties(void) {
 	int count = 0;
 	for (int i=0; i<(int)list.size(); i++) {
 		if (list[i]->empty()) {
-			delete list[i];
+			if (!isBlockEvent(list[i])) {
+				delete list[i];
+			}
 			list[i] = NULL;
 			count++;
 		}
@@ -263,6 +415,7 @@ void MidiEventList::removeEmpties(void) {
 		}
 	}
 	list.swap(newlist);
+	sortorder = -1;
 }
 
 
@@ -286,15 +439,30 @@ int MidiEventList::linkEventPairs(void) {
 
 int MidiEventList::linkNotePairs(void) {
 
-	// Note-on states:
-	// dimension 1: MIDI channel (0-15)
-	// dimension 2: MIDI key     (0-127)  (but 0 not used for note-ons)
-	// dimension 3: List of active note-ons or note-offs.
-	std::vector<std::vector<std::vector<MidiEvent*>>> noteons;
-	noteons.resize(16);
-	for (int i=0; i<(int)noteons.size(); i++) {
-		noteons[i].resize(128);
+	// Note-on states are kept in scratch arrays which are reused between
+	// calls (one set for each thread), so that linking does not allocate
+	// memory once the arrays are large enough:
+	// top:   index of the last unmatched note-on for each channel (0-15)
+	//        and key (0-255), or -1 if there is none.
+	// below: for each note-on in the list, the index of the unmatched
+	//        note-on which was on the same channel/key before it (-1 if none),
+	//        so that each channel/key has a stack of active note-ons.
+	// used:  channel/key slots of top which need to be reset after linking.
+	struct NoteStacks {
+		std::vector<int> top;
+		std::vector<int> below;
+		std::vector<int> used;
+	};
+	thread_local NoteStacks stacks;
+	if (stacks.top.empty()) {
+		stacks.top.assign(16 * 256, -1);
+	}
+	if ((int)stacks.below.size() < getSize()) {
+		stacks.below.resize(getSize());
 	}
+	stacks.used.clear();
+	int* top   = stacks.top.data();
+	int* below = stacks.below.data();
 
 	// Controller linking: The following General MIDI controller numbers are
 	// also monitored for linking within the track (but not between tracks).
@@ -318,76 +486,64 @@ int MidiEventList::linkNotePairs(void) {
 	// 5A  90   Undefined on/off                        0..63=off  64..127=on
 	// 7A 122   Local Keyboard On/Off                   0..63=off  64..127=on
 
-	// first keep track of whether the controller is an on/off switch:
-	std::vector<std::pair<int, int>> contmap;
-	contmap.resize(128);
-	std::pair<int, int> zero(0, 0);
-	std::fill(contmap.begin(), contmap.end(), zero);
-	contmap[64].first  = 1;   contmap[64].second = 0;
-	contmap[65].first  = 1;   contmap[65].second = 1;
-	contmap[66].first  = 1;   contmap[66].second = 2;
-	contmap[67].first  = 1;   contmap[67].second = 3;
-	contmap[68].first  = 1;   contmap[68].second = 4;
-	contmap[69].first  = 1;   contmap[69].second = 5;
-	contmap[80].first  = 1;   contmap[80].second = 6;
-	contmap[81].first  = 1;   contmap[81].second = 7;
-	contmap[82].first  = 1;   contmap[82].second = 8;
-	contmap[83].first  = 1;   contmap[83].second = 9;
-	contmap[84].first  = 1;   contmap[84].second = 10;
-	contmap[85].first  = 1;   contmap[85].second = 11;
-	contmap[86].first  = 1;   contmap[86].second = 12;
-	contmap[87].first  = 1;   contmap[87].second = 13;
-	contmap[88].first  = 1;   contmap[88].second = 14;
-	contmap[89].first  = 1;   contmap[89].second = 15;
-	contmap[90].first  = 1;   contmap[90].second = 16;
-	contmap[122].first = 1;   contmap[122].second = 17;
+	// first keep track of whether the controller is an on/off switch
+	// (the index of the switch, or -1 for other controllers):
+	static const signed char contmap[128] = {
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		 0,  1,  2,  3,  4,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		 6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 17, -1, -1, -1, -1, -1
+	};
 
 	// dimensions:
 	// 1: mapped controller (0 to 17)
 	// 2: channel (0 to 15)
-	std::vector<std::vector<MidiEvent*>> contevents;
-	contevents.resize(18);
-	std::vector<std::vector<int>> oldstates;
-	oldstates.resize(18);
+	MidiEvent* contevents[18][16];
+	int oldstates[18][16];
 	for (int i=0; i<18; i++) {
-		contevents[i].resize(16);
-		std::fill(contevents[i].begin(), contevents[i].end(), nullptr);
-		oldstates[i].resize(16);
-		std::fill(oldstates[i].begin(), oldstates[i].end(), -1);
+		for (int j=0; j<16; j++) {
+			contevents[i][j] = nullptr;
+			oldstates[i][j] = -1;
+		}
 	}
 
 	// Now iterate through the MidiEventList keeping track of note and
 	// select controller states and linking notes/controllers as needed.
 	int channel;
-	int key;
+	int slot;
 	int contnum;
 	int contval;
 	int conti;
 	int contstate;
 	int counter = 0;
 	MidiEvent* mev;
-	MidiEvent* noteon;
 	for (int i=0; i<getSize(); i++) {
 		mev = &getEvent(i);
 		mev->unlinkEvent();
 		if (mev->isNoteOn()) {
 			// store the note-on to pair later with a note-off message.
-			key = mev->getKeyNumber();
-			channel = mev->getChannel();
-			noteons[channel][key].push_back(mev);
+			slot = mev->getChannel() * 256 + mev->getKeyNumber();
+			if (top[slot] < 0) {
+				stacks.used.push_back(slot);
+			}
+			below[i] = top[slot];
+			top[slot] = i;
 		} else if (mev->isNoteOff()) {
-			key = mev->getKeyNumber();
-			channel = mev->getChannel();
-			if (noteons[channel][key].size() > 0) {
-				noteon = noteons[channel][key].back();
-				noteons[channel][key].pop_back();
-				noteon->linkEvent(mev);
+			slot = mev->getChannel() * 256 + mev->getKeyNumber();
+			if (top[slot] >= 0) {
+				int noteon = top[slot];
+				top[slot] = below[noteon];
+				getEvent(noteon).linkEvent(mev);
 				counter++;
 			}
 		} else if (mev->isController()) {
 			contnum = mev->getP1();
-			if (contmap[contnum].first) {
-				conti     = contmap[contnum].second;
+			conti = contnum < 128 ? contmap[contnum] : -1;
+			if (conti >= 0) {
 				channel   = mev->getChannel();
 				contval   = mev->getP2();
 				contstate = contval < 64 ? 0 : 1;
@@ -413,6 +569,11 @@ int MidiEventList::linkNotePairs(void) {
 			}
 		}
 	}
+
+	// leave the note-on stacks empty for the next call
+	for (int i=0; i<(int)stacks.used.size(); i++) {
+		top[stacks.used[i]] = -1;
+	}
 	return counter;
 }
 
@@ -443,6 +604,7 @@ void MidiEventList::clearSequence(void) {
 	for (int i=0; i<getEventCount(); i++) {
 		getEvent(i).seq = 0;
 	}
+	sortorder = -1;
 }
 
 
@@ -466,10 +628,116 @@ int MidiEventList::markSequence(int sequence) {
 	for (int i=0; i<getEventCount(); i++) {
 		getEvent(i).seq = sequence++;
 	}
+	sortorder = -1;
 	return sequence;
 }
 
 
+
+//////////////////////////////
+//
+// MidiEventList::makeContiguous -- Move all MidiEvents in the list into
+//   one block of memory, in list order, so that passes through the list
+//   read the events sequentially.  The addresses of the events change,
+//   but links between note-ons and note-offs (and any other linked
+//   events) are kept.  References to events in the list are not valid
+//   after calling this function.  Later additions to the list are stored
+//   separately until makeContiguous() is called again, and sorting
+//   reorders the list, so call it after such changes if needed.
+//
+
+void MidiEventList::makeContiguous(void) {
+	if (isContiguous()) {
+		return;
+	}
+	auto block = std::make_shared<std::vector<MidiEvent>>();
+	block->reserve(list.size());
+	for (int i=0; i<(int)list.size(); i++) {
+		block->emplace_back(std::move(*list[i]));
+		if (!isBlockEvent(list[i])) {
+			delete list[i];
+		}
+		list[i] = &block->back();
+	}
+	blocks.clear();
+	fillblock = NULL;
+	addBlock(block);
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::isContiguous -- Returns true if the MidiEvents are stored
+//   in one block of memory in list order.
+//
+
+bool MidiEventList::isContiguous(void) const {
+	if (list.empty()) {
+		return true;
+	}
+	if ((blocks.size() != 1) || (blocks[0]->size() != list.size())) {
+		return false;
+	}
+	const MidiEvent* block = blocks[0]->data();
+	for (int i=0; i<(int)list.size(); i++) {
+		if (list[i] != block + i) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::getTickRange -- Find the events with a tick from starttick
+//   up to (but not including) endtick, which are the events from startindex
+//   to endindex-1.  The range is found with a binary search, so the events
+//   must be in tick order; whether they are is checked once and remembered
+//   until the list is changed with its own functions.  Ticks which are
+//   assigned directly to the events are not noticed, so call
+//   clearTickIndex() after such changes.  Returns false (with an empty
+//   range) if the events are not in tick order.
+//
+
+bool MidiEventList::getTickRange(int starttick, int endtick, int& startindex,
+		int& endindex) const {
+	startindex = 0;
+	endindex = 0;
+	if (!isTickSorted()) {
+		return false;
+	}
+	auto before = [](const MidiEvent* event, int tick) {
+		return event->tick < tick;
+	};
+	auto first = std::lower_bound(list.begin(), list.end(), starttick, before);
+	startindex = (int)(first - list.begin());
+	if (endtick <= starttick) {
+		endindex = startindex;
+	} else {
+		endindex = (int)(std::lower_bound(first, list.end(), endtick, before) -
+				list.begin());
+	}
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::clearTickIndex -- Check the tick order of the events
+//   again in the next getTickRange() or insertSorted().  This is needed
+//   after assigning ticks to the events of the list directly (changes
+//   made with the functions of the list are noticed automatically).
+//
+
+void MidiEventList::clearTickIndex(void) {
+	sortorder = -1;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////
 //
 // protected functions --
@@ -485,6 +753,7 @@ int MidiEventList::markSequence(int sequence) {
 
 void MidiEventList::detach(void) {
 	list.resize(0);
+	sortorder = -1;
 }
 
 
@@ -498,11 +767,102 @@ void MidiEventList::detach(void) {
 
 int MidiEventList::push_back_no_copy(MidiEvent* event) {
 	list.push_back(event);
+	sortorder = -1;
 	return (int)list.size()-1;
 }
 
 
 
+//////////////////////////////
+//
+// MidiEventList::shareBlocks -- Keep the event blocks of another list
+//     allocated while this list holds any of its events.  This must be
+//     called when events from a list with blocks are moved into another
+//     list with push_back_no_copy(), before the other list is cleared or
+//     deleted.  Only the blocks which contain events of this list are
+//     shared.
+//
+
+void MidiEventList::shareBlocks(const MidiEventList& other) {
+	if (other.blocks.empty()) {
+		return;
+	}
+	std::vector<char> used(other.blocks.size(), 0);
+	int count = 0;
+	for (int i=0; i<(int)list.size(); i++) {
+		int index = other.findBlock(list[i]);
+		if ((index >= 0) && !used[index]) {
+			used[index] = 1;
+			if (++count == (int)used.size()) {
+				break;
+			}
+		}
+	}
+	for (int i=0; i<(int)other.blocks.size(); i++) {
+		if (used[i]) {
+			addBlock(other.blocks[i]);
+		}
+	}
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::reserveBlock -- Add a block of memory for storing the
+//     given number of events which are created with newEvent().
+//
+
+void MidiEventList::reserveBlock(int count) {
+	if (count <= 0) {
+		return;
+	}
+	auto block = std::make_shared<std::vector<MidiEvent>>();
+	block->reserve(count);
+	addBlock(block);
+	fillblock = block.get();
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::newEvent -- Return an empty MidiEvent which is stored in
+//     the last block reserved with reserveBlock(), or which is allocated
+//     separately if the block is full.  The event is not added to the
+//     list; use push_back_no_copy() for that, or deleteEvent() if it
+//     is not needed.
+//
+
+MidiEvent* MidiEventList::newEvent(void) {
+	if ((fillblock != NULL) && (fillblock->size() < fillblock->capacity())) {
+		fillblock->emplace_back();
+		return &fillblock->back();
+	}
+	return new MidiEvent;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::deleteEvent -- Free an event from newEvent() which was
+//     not added to the list.
+//
+
+void MidiEventList::deleteEvent(MidiEvent* event) {
+	int index = findBlock(event);
+	if (index < 0) {
+		delete event;
+		return;
+	}
+	if (event == &blocks[index]->back()) {
+		blocks[index]->pop_back();
+	}
+}
+
+
+
 //////////////////////////////
 //
 // MidiEventList::operator=(MidiEventList) -- Assignment.
@@ -510,6 +870,9 @@ int MidiEventList::push_back_no_copy(MidiEvent* event) {
 
 MidiEventList& MidiEventList::operator=(MidiEventList& other) {
 	list.swap(other.list);
+	blocks.swap(other.blocks);
+	std::swap(fillblock, other.fillblock);
+	std::swap(sortorder, other.sortorder);
 	return *this;
 }
 
@@ -525,10 +888,343 @@ MidiEventList& MidiEventList::operator=(MidiEventList& other) {
 //    track of delta versus absolute tick states of the MidiEventList,
 //    and sorting is only allowed in absolute tick state (The MidiEventList
 //    does not know about delta/absolute tick states of its contents).
+//    The order is the same as sorting with eventcompare(), but the sorting
+//    keys of the events are calculated once beforehand: a 64-bit primary
+//    key from the tick and sequence number, and a secondary key for the
+//    message type (meta, other, note-off, note-on, end-of-track) and
+//    controller number/value.  Events with equal keys keep their current
+//    order (qsort() gave no such guarantee).  If only some events have sequence
+//    numbers, eventcompare() does not give a consistent order, and qsort()
+//    is used with it directly.
 //
 
 void MidiEventList::sort(void) {
-	qsort(data(), getEventCount(), sizeof(MidiEvent*), eventcompare);
+	int count = getEventCount();
+	if (count < 2) {
+		return;
+	}
+	int seqstate = getSequenceState();
+	if (seqstate < 0) {
+		qsort(data(), count, sizeof(MidiEvent*), eventcompare);
+		return;
+	}
+	std::vector<SortKey> keys;
+	if (!makeSortKeys(keys, seqstate)) {
+		std::sort(keys.begin(), keys.end());
+		std::vector<MidiEvent*> newlist(count);
+		for (int i=0; i<count; i++) {
+			newlist[i] = list[keys[i].index];
+		}
+		list.swap(newlist);
+	}
+	sortorder = seqstate ? 3 : 2;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::makeSortKeys -- Calculate the sorting keys of all events
+//    in the list.  Returns true if the list is already sorted.
+//
+
+bool MidiEventList::makeSortKeys(std::vector<SortKey>& keys, bool useseq) const {
+	int count = (int)list.size();
+	keys.resize(count);
+	bool sortedQ = true;
+	for (int i=0; i<count; i++) {
+		keys[i] = getSortKey(*list[i], useseq, i);
+		if (sortedQ && (i > 0) && (keys[i] < keys[i-1])) {
+			sortedQ = false;
+		}
+	}
+	return sortedQ;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::SortKey::operator< -- Order by primary key, then secondary
+//    key, and then list index so that events with the same keys stay in
+//    their current order.
+//
+
+bool MidiEventList::SortKey::operator<(const SortKey& other) const {
+	if (primary != other.primary) {
+		return primary < other.primary;
+	}
+	if (secondary != other.secondary) {
+		return secondary < other.secondary;
+	}
+	return index < other.index;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::getSequenceState -- Returns 1 if all events have a
+//    sequence number (see markSequence()), 0 if none do (or the list is
+//    empty), or -1 if only some of them do.
+//
+
+int MidiEventList::getSequenceState(void) const {
+	int zeros = 0;
+	for (int i=0; i<(int)list.size(); i++) {
+		zeros += list[i]->seq == 0;
+	}
+	if (zeros == (int)list.size()) {
+		return 0;
+	}
+	return zeros == 0 ? 1 : -1;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::getSortPrimary -- Return the primary sorting key of an
+//    event: the tick in the upper 32 bits, and the sequence number in the
+//    lower 32 bits if sequence numbers are used (both signed values are
+//    offset so that they compare correctly as unsigned numbers).
+//
+
+uint64_t MidiEventList::getSortPrimary(const MidiEvent& event, bool useseq) {
+	uint64_t output = (uint64_t)((uint32_t)event.tick ^ 0x80000000u) << 32;
+	if (useseq) {
+		output |= (uint32_t)event.seq ^ 0x80000000u;
+	}
+	return output;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::getSortSecondary -- Return the sorting key for events at
+//    the same tick (and with the same sequence number), following the
+//    rules of eventcompare(): bits 19-21 are the rank of the message type
+//    (0 = meta message, 1 = other, 2 = note-off, 3 = note-on, 4 = end of
+//    track), and for controllers the lower bits store the controller
+//    number and value.  Other messages of rank 1 are placed after
+//    controllers, since eventcompare() does not order them.
+//
+
+uint32_t MidiEventList::getSortSecondary(const MidiEvent& event) {
+	// bytes are read directly (-1 if missing, as from getP0/getP1/getP2)
+	int size = (int)event.size();
+	int p0 = size < 1 ? -1 : event[0];
+	int p1 = size < 2 ? -1 : event[1];
+	int p2 = size < 3 ? -1 : event[2];
+	if (p0 == 0xff) {
+		return p1 == 0x2f ? 4 << 19 : 0;
+	}
+	int nibble = p0 & 0xf0;
+	if ((nibble == 0x90) && (p2 != 0)) {
+		return 3 << 19;
+	}
+	if ((nibble == 0x90) || (nibble == 0x80)) {
+		return 2 << 19;
+	}
+	if (nibble == 0xb0) {
+		return (1 << 19) | ((p1 + 1) << 9) | (p2 + 1);
+	}
+	return (1 << 19) | (1 << 18);
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::isBlockEvent -- Returns true if the event is stored in
+//    one of the blocks of the list (in which case it is not deleted
+//    separately).
+//
+
+bool MidiEventList::isBlockEvent(const MidiEvent* event) const {
+	return findBlock(event) >= 0;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::findBlock -- Return the index of the block which stores
+//    the event, or -1 if it is not stored in a block.
+//
+
+int MidiEventList::findBlock(const MidiEvent* event) const {
+	std::less<const MidiEvent*> before;
+	// first block which starts after the event:
+	auto position = std::upper_bound(blocks.begin(), blocks.end(), event,
+		[&before](const MidiEvent* value,
+				const std::shared_ptr<std::vector<MidiEvent>>& block) {
+			return before(value, block->data());
+		});
+	if (position == blocks.begin()) {
+		return -1;
+	}
+	int index = (int)(position - blocks.begin()) - 1;
+	const std::vector<MidiEvent>& block = *blocks[index];
+	if (before(event, block.data() + block.size())) {
+		return index;
+	}
+	return -1;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::addBlock -- Add a block to the list of blocks, keeping
+//    them in address order.  Blocks which are already present or which
+//    have no memory are ignored.
+//
+
+void MidiEventList::addBlock(const std::shared_ptr<std::vector<MidiEvent>>& block) {
+	if (block->capacity() == 0) {
+		return;
+	}
+	std::less<const MidiEvent*> before;
+	auto position = std::lower_bound(blocks.begin(), blocks.end(), block,
+		[&before](const std::shared_ptr<std::vector<MidiEvent>>& value,
+				const std::shared_ptr<std::vector<MidiEvent>>& other) {
+			return before(value->data(), other->data());
+		});
+	if ((position != blocks.end()) && (*position == block)) {
+		return;
+	}
+	blocks.insert(position, block);
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::isTickSorted -- Returns true if the ticks of the events
+//   never decrease.  The result is stored until the list changes.
+//
+
+bool MidiEventList::isTickSorted(void) const {
+	if (sortorder < 0) {
+		sortorder = 1;
+		for (int i=1; i<(int)list.size(); i++) {
+			if (list[i]->tick < list[i-1]->tick) {
+				sortorder = 0;
+				break;
+			}
+		}
+	}
+	return sortorder >= 1;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::getSortKey -- Return the sorting key of an event at the
+//   given list index (see sort()).
+//
+
+MidiEventList::SortKey MidiEventList::getSortKey(const MidiEvent& event,
+		bool useseq, int index) {
+	SortKey output;
+	output.primary   = getSortPrimary(event, useseq);
+	output.secondary = getSortSecondary(event);
+	output.index     = index;
+	return output;
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::prepareSortedInsert -- Make sure that the list is sorted
+//   before inserting events with (seqstate = 1) or without (seqstate = 0)
+//   sequence numbers.  The sorting state is stored in sortorder, so the
+//   list is only checked (and sorted if needed) after it has been changed
+//   or clearTickIndex() has been called.  Returns how the events are
+//   placed (see isKeyBefore()): 0 = by sorting keys without sequence
+//   numbers, 1 = by sorting keys with sequence numbers, 2 = after the
+//   events at the same tick, for events without sequence numbers in a
+//   list with them.  Returns -1 if the list already contains events both
+//   with and without sequence numbers, or if events with sequence numbers
+//   are added to a list without them, which sort() does not order by
+//   sorting keys.
+//
+
+int MidiEventList::prepareSortedInsert(int seqstate) {
+	if (list.empty()) {
+		sortorder = seqstate ? 3 : 2;
+		return seqstate;
+	}
+	if (sortorder == 3) {
+		return seqstate ? 1 : 2;
+	}
+	if (sortorder == 2) {
+		return seqstate ? -1 : 0;
+	}
+	int state = getSequenceState();
+	if ((state < 0) || (state < seqstate)) {
+		return -1;
+	}
+	if (isSortedBy(state)) {
+		sortorder = state ? 3 : 2;
+	} else {
+		sort();
+	}
+	return prepareSortedInsert(seqstate);
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::isKeyBefore -- Returns true if an event with the given
+//   sorting key is placed before the event in the list, for the placing
+//   mode from prepareSortedInsert().
+//
+
+bool MidiEventList::isKeyBefore(const SortKey& key, const MidiEvent& event,
+		int mode) {
+	if (mode == 2) {
+		// only the tick, so that the key is placed after the same tick
+		return key.primary < getSortPrimary(event, false);
+	}
+	return key < getSortKey(event, mode == 1, key.index);
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::isSortedBy -- Returns true if the events are in the order
+//   of their sorting keys, with (useseq = true) or without sequence numbers.
+//
+
+bool MidiEventList::isSortedBy(bool useseq) const {
+	for (int i=1; i<(int)list.size(); i++) {
+		const MidiEvent& event = *list[i];
+		const MidiEvent& last  = *list[i-1];
+		if (event.tick != last.tick) {
+			if (event.tick < last.tick) {
+				return false;
+			}
+			continue;
+		}
+		if (useseq && (event.seq != last.seq)) {
+			if (event.seq < last.seq) {
+				return false;
+			}
+			continue;
+		}
+		// secondary keys are only needed for events at the same time:
+		if (getSortSecondary(event) < getSortSecondary(last)) {
+			return false;
+		}
+	}
+	return true;
 }
 
 
@@ -4,7 +4,7 @@
 // Last Modified: Thu Jun 24 18:35:30 PDT 2021 Added base64 encoding read/write
 // Filename:      midifile/src/MidiFile.cpp
 // Website:       http://midifile.sapp.org
-// Syntax:        C++11
+// Syntax:        C++17
 // vim:           ts=3 noexpandtab
 //
 // Description:   A class which can read/write Standard MIDI files.
@@ -14,6 +14,8 @@
 
 #include "MidiFile.h"
 #include "Binasc.h"
+#include "SmfReader.h"
+#include "Vlv.h"
 
 #include <string>
 #include <vector>
@@ -23,11 +25,68 @@
 #include <sstream>
 #include <iterator>
 #include <algorithm>
+#include <cstring>
+#include <thread>
 
 
 namespace smf {
 
 
+//////////////////////////////
+//
+// parallelFor -- Call a function for each index from 0 to count-1, using
+//     up to the given number of threads (including the calling thread).
+//     Indexes are handed out one at a time, so threads which get small
+//     items go on to the next one.
+//
+
+static void parallelFor(int count, int threads,
+		const std::function<void(int)>& function) {
+	if (threads > count) {
+		threads = count;
+	}
+	if (threads <= 1) {
+		for (int i=0; i<count; i++) {
+			function(i);
+		}
+		return;
+	}
+	std::atomic<int> next(0);
+	auto worker = [&]() {
+		int i;
+		while ((i = next++) < count) {
+			function(i);
+		}
+	};
+	std::vector<std::thread> workers;
+	workers.reserve(threads - 1);
+	for (int i=1; i<threads; i++) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (auto& thread : workers) {
+		thread.join();
+	}
+}
+
+
+
+//////////////////////////////
+//
+// getThreadCount -- Return the number of threads for a thread count
+//     setting, where 0 means one thread per processor core.
+//
+
+static int getThreadCount(int setting) {
+	if (setting > 0) {
+		return setting;
+	}
+	int output = (int)std::thread::hardware_concurrency();
+	return output > 0 ? output : 1;
+}
+
+
+
 const std::string MidiFile::encodeLookup = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=";
 
 const std::vector<int> MidiFile::decodeLookup {
@@ -155,7 +214,14 @@ MidiFile& MidiFile::operator=(const MidiFile& other) {
 	m_readFileName        = other.m_readFileName;
 	m_timemapvalid        = other.m_timemapvalid;
 	m_timemap             = other.m_timemap;
-	m_rwstatus            = other.m_rwstatus;
+	m_rwstatus            = other.m_rwstatus.load();
+	m_readFilter          = other.m_readFilter;
+	m_readPredicate       = other.m_readPredicate;
+	m_payloadViews        = other.m_payloadViews;
+	m_eventPrecount       = other.m_eventPrecount;
+	m_runningStatus       = other.m_runningStatus;
+	m_writeThreads        = other.m_writeThreads;
+	m_contiguousEvents    = other.m_contiguousEvents;
 	if (other.m_linkedEventsQ) {
 		linkEventPairs();
 	}
@@ -175,7 +241,15 @@ MidiFile& MidiFile::operator=(MidiFile&& other) {
 	m_readFileName        = other.m_readFileName;
 	m_timemapvalid        = other.m_timemapvalid;
 	m_timemap             = other.m_timemap;
-	m_rwstatus            = other.m_rwstatus;
+	m_rwstatus            = other.m_rwstatus.load();
+	m_readFilter          = other.m_readFilter;
+	m_readPredicate       = other.m_readPredicate;
+	m_payloadViews        = other.m_payloadViews;
+	m_eventPrecount       = other.m_eventPrecount;
+	m_runningStatus       = other.m_runningStatus;
+	m_writeThreads        = other.m_writeThreads;
+	m_contiguousEvents    = other.m_contiguousEvents;
+	m_rawdata             = std::move(other.m_rawdata);
 	return *this;
 }
 
@@ -223,13 +297,13 @@ bool MidiFile::read(std::istream& input) {
 		std::stringstream binarydata;
 		Binasc binasc;
 		binasc.writeToBinary(binarydata, input);
-		binarydata.seekg(0, std::ios_base::beg);
-		if (binarydata.peek() != 'M') {
+		std::string bytes = binarydata.str();
+		if (bytes.empty() || (bytes[0] != 'M')) {
 			std::cerr << "Bad MIDI data input" << std::endl;
 			m_rwstatus = false;
 			return m_rwstatus;
 		} else {
-			m_rwstatus = readSmf(binarydata);
+			m_rwstatus = readSmf((const uchar*)bytes.data(), bytes.size());
 			return m_rwstatus;
 		}
 	} else {
@@ -238,6 +312,24 @@ bool MidiFile::read(std::istream& input) {
 	}
 }
 
+//
+// Memory version of read().  Standard MIDI File data is parsed in place
+// without being copied (unless payload views are active, in which case
+// the MidiFile needs its own copy of the bytes).
+//
+
+bool MidiFile::read(const uchar* data, size_t size) {
+	m_rwstatus = true;
+	if ((size == 0) || (data[0] != 'M')) {
+		// binasc content
+		std::istringstream input(std::string((const char*)data, size));
+		m_rwstatus = read(input);
+		return m_rwstatus;
+	}
+	m_rwstatus = readSmf(data, size);
+	return m_rwstatus;
+}
+
 
 
 //////////////////////////////
@@ -247,17 +339,26 @@ bool MidiFile::read(std::istream& input) {
 //
 
 bool MidiFile::readBase64(const std::string& base64data) {
-	std::stringstream stream;
-	stream << MidiFile::base64Decode(base64data);
-	return MidiFile::read(stream);
+	std::vector<uchar> buffer;
+	return readBase64(base64data, buffer);
 }
 
 bool MidiFile::readBase64(std::istream& instream) {
 	std::string base64data((std::istreambuf_iterator<char>(instream)),
 			std::istreambuf_iterator<char>());
-	std::stringstream stream;
-	stream << MidiFile::base64Decode(base64data);
-	return MidiFile::read(stream);
+	std::vector<uchar> buffer;
+	return readBase64(base64data, buffer);
+}
+
+//
+// Version of readBase64() which decodes into the given buffer, so that
+// its allocation can be reused when reading many base64 strings.
+//
+
+bool MidiFile::readBase64(const std::string& base64data,
+		std::vector<uchar>& buffer) {
+	base64Decode(base64data.data(), base64data.size(), buffer);
+	return read(buffer.data(), buffer.size());
 }
 
 
@@ -295,102 +396,73 @@ bool MidiFile::readSmf(const std::string& filename) {
 bool MidiFile::readSmf(std::istream& input) {
 	m_rwstatus = true;
 
-	std::string filename = getFilename();
-
-	int    character;
-	// uchar  buffer[123456] = {0};
-	ulong  longdata;
-	ushort shortdata;
-
-	// Read the MIDI header (4 bytes of ID, 4 byte data size,
-	// anticipated 6 bytes of data.
-
-	character = input.get();
-	if (character == EOF) {
-		std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-		std::cerr << "Expecting 'M' at first byte, but found nothing." << std::endl;
-		m_rwstatus = false; return m_rwstatus;
-	} else if (character != 'M') {
-		std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-		std::cerr << "Expecting 'M' at first byte but got '"
-		     << (char)character << "'" << std::endl;
+	std::vector<uchar> buffer;
+	if (!readAllBytes(input, buffer)) {
+		std::cerr << "Error: cannot read MIDI data from input stream." << std::endl;
 		m_rwstatus = false; return m_rwstatus;
 	}
+	return readSmfBuffer(buffer);
+}
 
-	character = input.get();
-	if (character == EOF) {
-		std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-		std::cerr << "Expecting 'T' at second byte, but found nothing." << std::endl;
-		m_rwstatus = false; return m_rwstatus;
-	} else if (character != 'T') {
-		std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-		std::cerr << "Expecting 'T' at second byte but got '"
-		     << (char)character << "'" << std::endl;
-		m_rwstatus = false; return m_rwstatus;
-	}
+//
+// Memory version of readSmf().
+//
 
-	character = input.get();
-	if (character == EOF) {
-		std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-		std::cerr << "Expecting 'h' at third byte, but found nothing." << std::endl;
-		m_rwstatus = false; return m_rwstatus;
-	} else if (character != 'h') {
-		std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-		std::cerr << "Expecting 'h' at third byte but got '"
-		     << (char)character << "'" << std::endl;
-		m_rwstatus = false; return m_rwstatus;
+bool MidiFile::readSmf(const uchar* data, size_t size) {
+	if (m_payloadViews) {
+		std::vector<uchar> buffer(data, data + size);
+		return readSmfBuffer(buffer);
 	}
+	return parseSmf(data, size);
+}
 
-	character = input.get();
-	if (character == EOF) {
-		std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-		std::cerr << "Expecting 'd' at fourth byte, but found nothing." << std::endl;
-		m_rwstatus = false; return m_rwstatus;
-	} else if (character != 'd') {
-		std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-		std::cerr << "Expecting 'd' at fourth byte but got '"
-		     << (char)character << "'" << std::endl;
-		m_rwstatus = false; return m_rwstatus;
-	}
 
-	// read header size (allow larger header size?)
-	longdata = readLittleEndian4Bytes(input);
-	if (longdata != 6) {
-		std::cerr << "File " << filename
-		     << " is not a MIDI 1.0 Standard MIDI file." << std::endl;
-		std::cerr << "The header size is " << longdata << " bytes." << std::endl;
-		m_rwstatus = false; return m_rwstatus;
-	}
 
-	// Header parameter #1: format type
-	int type;
-	shortdata = readLittleEndian2Bytes(input);
-	switch (shortdata) {
-		case 0:
-			type = 0;
-			break;
-		case 1:
-			type = 1;
-			break;
-		case 2:
-			// Type-2 MIDI files should probably be allowed as well,
-			// but I have never seen one in the wild to test with.
-		default:
-			std::cerr << "Error: cannot handle a type-" << shortdata
-			     << " MIDI file" << std::endl;
-			m_rwstatus = false; return m_rwstatus;
+//////////////////////////////
+//
+// MidiFile::readSmfBuffer -- Parse Standard MIDI File bytes which can be
+//     taken over by the MidiFile if payload views are used.
+//
+
+bool MidiFile::readSmfBuffer(std::vector<uchar>& buffer) {
+	parseSmf(buffer.data(), buffer.size());
+
+	// Payload views of the new events point into the buffer, so keep it.
+	// m_rawdata is emptied by clear() once the old tracks are deleted, so
+	// it is only still filled if parsing failed before any events were
+	// replaced.
+	if (m_payloadViews && m_rawdata.empty()) {
+		m_rawdata.swap(buffer);
 	}
+	return m_rwstatus;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::parseSmf -- Parse the bytes of a Standard MIDI File and store
+//     its contents in the object.
+//
+
+bool MidiFile::parseSmf(const uchar* data, size_t size) {
+	m_rwstatus = true;
+
+	std::string filename = getFilename();
+	const uchar* ptr = data;
+	const uchar* end = data + size;
+
+	// Read the MIDI header (4 bytes of ID, 4 byte data size,
+	// anticipated 6 bytes of data.
 
-	// Header parameter #2: track count
-	int tracks;
-	shortdata = readLittleEndian2Bytes(input);
-	if (type == 0 && shortdata != 1) {
-		std::cerr << "Error: Type 0 MIDI file can only contain one track" << std::endl;
-		std::cerr << "Instead track count is: " << shortdata << std::endl;
+	SmfHeader header;
+	int status = SmfReader::readHeader(ptr, end, header);
+	if (status != SmfReader::SMF_OK) {
+		std::cerr << "Error: file " << filename << ": "
+		     << SmfReader::getErrorMessage(status) << std::endl;
 		m_rwstatus = false; return m_rwstatus;
-	} else {
-		tracks = shortdata;
 	}
+	int tracks = header.tracks;
 	clear();
 	if (m_events[0] != NULL) {
 		delete m_events[0];
@@ -398,15 +470,11 @@ bool MidiFile::readSmf(std::istream& input) {
 	m_events.resize(tracks);
 	for (int z=0; z<tracks; z++) {
 		m_events[z] = new MidiEventList;
-		m_events[z]->reserve(10000);   // Initialize with 10,000 event storage.
-		m_events[z]->clear();
 	}
 
-	// Header parameter #3: Ticks per quarter note
-	shortdata = readLittleEndian2Bytes(input);
-	if (shortdata >= 0x8000) {
-		int framespersecond = 255 - ((shortdata >> 8) & 0x00ff) + 1;
-		int subframes       = shortdata & 0x00ff;
+	// Ticks per quarter note
+	if (header.division >= 0x8000) {
+		int framespersecond = 255 - ((header.division >> 8) & 0x00ff) + 1;
 		switch (framespersecond) {
 			case 25:  framespersecond = 25; break;
 			case 24:  framespersecond = 24; break;
@@ -416,14 +484,8 @@ bool MidiFile::readSmf(std::istream& input) {
 					std::cerr << "Warning: unknown FPS: " << framespersecond << std::endl;
 					std::cerr << "Using non-standard FPS: " << framespersecond << std::endl;
 		}
-		m_ticksPerQuarterNote = framespersecond * subframes;
-
-		// std::cerr << "SMPTE ticks: " << m_ticksPerQuarterNote << " ticks/sec" << std::endl;
-		// std::cerr << "SMPTE frames per second: " << framespersecond << std::endl;
-		// std::cerr << "SMPTE subframes per frame: " << subframes << std::endl;
-	}  else {
-		m_ticksPerQuarterNote = shortdata;
 	}
+	m_ticksPerQuarterNote = header.getTicksPerQuarterNote();
 
 
 	//////////////////////////////////////////////////
@@ -431,107 +493,101 @@ bool MidiFile::readSmf(std::istream& input) {
 	// now read individual tracks:
 	//
 
-	uchar runningCommand;
-	MidiEvent event;
+	ulong chunksize;
 	std::vector<uchar> bytes;
-	int xstatus;
+	MidiEvent* event = NULL;
 
 	for (int i=0; i<tracks; i++) {
-		runningCommand = 0;
-
-		// std::cout << "\nReading Track: " << i + 1 << flush;
-
-		// read track header...
-
-		character = input.get();
-		if (character == EOF) {
-			std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-			std::cerr << "Expecting 'M' at first byte in track, but found nothing."
+		// The track chunk size is not really necessary since the track
+		// MUST end with an end of track meta event.
+		status = SmfReader::readTrackStart(ptr, end, chunksize);
+		if (status != SmfReader::SMF_OK) {
+			std::cerr << "Error: file " << filename << ": "
+			     << SmfReader::getErrorMessage(status) << " in track " << i
 			     << std::endl;
 			m_rwstatus = false; return m_rwstatus;
-		} else if (character != 'M') {
-			std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-			std::cerr << "Expecting 'M' at first byte in track but got '"
-			     << (char)character << "'" << std::endl;
-			m_rwstatus = false; return m_rwstatus;
 		}
 
-		character = input.get();
-		if (character == EOF) {
-			std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-			std::cerr << "Expecting 'T' at second byte in track, but found nothing."
-			     << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		} else if (character != 'T') {
-			std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-			std::cerr << "Expecting 'T' at second byte in track but got '"
-			     << (char)character << "'" << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		}
-
-		character = input.get();
-		if (character == EOF) {
-			std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-			std::cerr << "Expecting 'r' at third byte in track, but found nothing."
-			     << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		} else if (character != 'r') {
-			std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-			std::cerr << "Expecting 'r' at third byte in track but got '"
-			     << (char)character << "'" << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		}
-
-		character = input.get();
-		if (character == EOF) {
-			std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-			std::cerr << "Expecting 'k' at fourth byte in track, but found nothing."
-			     << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		} else if (character != 'k') {
-			std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-			std::cerr << "Expecting 'k' at fourth byte in track but got '"
-			     << (char)character << "'" << std::endl;
-			m_rwstatus = false; return m_rwstatus;
+		// Set the size of the track allocation: either count the events
+		// in the track first, or use an upper limit from the chunk size
+		// (each event needs at least two bytes).  Contiguous events are
+		// always counted, since the block for them is allocated exactly.
+		MidiEventList& list = *m_events[i];
+		list.clear();
+		if (m_eventPrecount || m_contiguousEvents) {
+			int count = countTrackEvents(ptr, end);
+			list.reserve(count);
+			if (m_contiguousEvents) {
+				list.reserveBlock(count);
+			}
+		} else {
+			list.reserve((int)(std::min(chunksize, (ulong)(end - ptr)) / 2));
 		}
 
-		// Now read track chunk size and throw it away because it is
-		// not really necessary since the track MUST end with an
-		// end of track meta event, and many MIDI files found in the wild
-		// do not correctly give the track size.
-		longdata = readLittleEndian4Bytes(input);
-
-		// Set the size of the track allocation so that it might
-		// approximately fit the data.
-		m_events[i]->reserve((int)longdata/2);
-		m_events[i]->clear();
-
-		// Read MIDI events in the track, which are pairs of VLV values
-		// and then the bytes for the MIDI message.  Running status messags
-		// will be filled in with their implicit command byte.
-		// The timestamps are converted from delta ticks to absolute ticks,
-		// with the absticks variable accumulating the VLV tick values.
-		int absticks = 0;
-		while (!input.eof()) {
-			longdata = readVLValue(input);
-			absticks += longdata;
-			xstatus = extractMidiData(input, bytes, runningCommand);
-			if (xstatus == 0) {
-				m_rwstatus = false; return m_rwstatus;
+		// Store the MIDI messages of the track in the form of MidiEvent
+		// bytes: running status messages are filled in with their implicit
+		// command byte, meta messages keep their type and length, and
+		// sysex messages do not store their length.  The timestamps are
+		// absolute ticks.
+		status = SmfReader::readTrack(ptr, end, [&](const SmfMessage& message) {
+			if (isFilteredEvent(message.command, message.metatype)) {
+				// Message type not wanted: its delta time is still included
+				// in the tick of later events so that they keep the correct
+				// timing.
+				return true;
 			}
-			event.setMessage(bytes);
-			event.tick = absticks;
-			event.track = i;
-
-			if (bytes[0] == 0xff && bytes[1] == 0x2f) {
-				// end-of-track message
-				// comment out the following line if you don't want to see the
-				// end of track message (which is always required, and will added
-				// automatically when a MIDI is written, so it is not necessary.
-				m_events[i]->push_back(event);
-				break;
+			bytes.clear();
+			bytes.push_back(message.command);
+			const uchar* payload = NULL;
+			int payloadsize = 0;
+			if (message.length == NULL) {
+				bytes.insert(bytes.end(), message.data, message.data + message.size);
+			} else {
+				if (message.isMeta()) {
+					bytes.push_back(message.metatype);
+					bytes.insert(bytes.end(), message.length, message.data);
+				}
+				// When payload views are active, the payload of sysex, text
+				// and sequencer-specific meta messages is not copied.
+				if (m_payloadViews && (!message.isMeta() ||
+						((message.metatype >= 0x01) && (message.metatype <= 0x0f)) ||
+						(message.metatype == 0x7f))) {
+					payload = message.data;
+					payloadsize = message.size;
+				} else {
+					bytes.insert(bytes.end(), message.data,
+							message.data + message.size);
+				}
+			}
+			if (event == NULL) {
+				event = list.newEvent();
+			}
+			event->setMessage(bytes);
+			event->setPayloadView(payload, payloadsize);
+			event->tick = message.tick;
+			event->track = i;
+
+			// End-of-track messages are always stored (they are required,
+			// and will be added automatically when a MIDI file is written).
+			if (!message.isEndOfTrack() && m_readPredicate &&
+					!m_readPredicate(*event)) {
+				return true;
 			}
-			m_events[i]->push_back(event);
+			list.push_back_no_copy(event);
+			event = NULL;
+			return true;
+		});
+		if (event != NULL) {
+			// filtered event
+			list.deleteEvent(event);
+			event = NULL;
+		}
+		if (status != SmfReader::SMF_OK) {
+			std::cerr << "Error: file " << filename << ": "
+			     << SmfReader::getErrorMessage(status) << " in track " << i
+			     << std::endl;
+			m_rwstatus = false;
+			break;
 		}
 	}
 
@@ -547,20 +603,376 @@ bool MidiFile::readSmf(std::istream& input) {
 
 
 
+//////////////////////////////
+//
+// MidiFile::countTrackEvents -- Return the number of events in the track
+//     data starting at the given position, up to and including the
+//     end-of-track message.  Counting stops early at malformed data (the
+//     parser will report the error).
+//
+
+int MidiFile::countTrackEvents(const uchar* ptr, const uchar* end) {
+	int count = 0;
+	SmfReader::readTrack(ptr, end, [&count](const SmfMessage&) {
+		count++;
+		return true;
+	});
+	return count;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::setReadFilter -- Only store the given types of messages
+//      (EVENT_TYPE_* bits) when reading a file.  The payloads of unwanted
+//      meta and system-exclusive messages are skipped without being copied.
+//      When given a function, it is called for each message which passes
+//      the type filter, and the event is stored only if it returns true.
+//      End-of-track messages are always stored.  The filter stays active
+//      for all later reads until clearReadFilter() is called.
+//
+
+void MidiFile::setReadFilter(int typemask) {
+	m_readFilter = typemask & EVENT_TYPE_ALL;
+}
+
+
+void MidiFile::setReadFilter(std::function<bool(const MidiEvent&)> keep) {
+	m_readPredicate = std::move(keep);
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::clearReadFilter -- Store all messages when reading.
+//
+
+void MidiFile::clearReadFilter(void) {
+	m_readFilter = EVENT_TYPE_ALL;
+	m_readPredicate = nullptr;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::getReadFilter -- Return the EVENT_TYPE_* mask of messages
+//      which are stored when reading.
+//
+
+int MidiFile::getReadFilter(void) const {
+	return m_readFilter;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::setPayloadViews -- When active, the payloads of system-exclusive,
+//      text and sequencer-specific meta messages read from a file are not
+//      copied into the MidiEvents.  Instead the events hold read-only views
+//      (MidiMessage::getPayload()) into a copy of the file bytes which is
+//      owned by the MidiFile and released when the tracks are cleared or
+//      another file is read.  size() and const operator[] of the events
+//      include the payload.  The payload is copied into an event when it
+//      is modified or its bytes are accessed as one array (data() and
+//      iterators), and copies of such events (including copies of the
+//      whole MidiFile) store their own payload.  Only access through a
+//      plain std::vector<uchar> reference sees the message header alone.
+//      Default is off.
+//
+
+void MidiFile::setPayloadViews(bool state) {
+	m_payloadViews = state;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::hasPayloadViews -- Returns true if payload views are used
+//      when reading.
+//
+
+bool MidiFile::hasPayloadViews(void) const {
+	return m_payloadViews;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::setEventPrecount -- When active, the events in each track are
+//      counted in a quick first pass before they are parsed, so that the
+//      event lists are allocated with their exact size.  Otherwise the
+//      allocation is estimated from the track chunk size.  Default is off.
+//
+
+void MidiFile::setEventPrecount(bool state) {
+	m_eventPrecount = state;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::hasEventPrecount -- Returns true if event counting is done
+//      before parsing tracks.
+//
+
+bool MidiFile::hasEventPrecount(void) const {
+	return m_eventPrecount;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::setContiguousEvents -- When active, the events of each track
+//      read from a file are stored together in one block of memory (see
+//      MidiEventList::makeContiguous()) instead of being allocated one
+//      at a time, so that passes through a track read memory sequentially.
+//      Default is off.
+//
+
+void MidiFile::setContiguousEvents(bool state) {
+	m_contiguousEvents = state;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::hasContiguousEvents -- Returns true if track events are
+//      stored contiguously when reading.
+//
+
+bool MidiFile::hasContiguousEvents(void) const {
+	return m_contiguousEvents;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::setRunningStatus -- When active, the command byte of a channel
+//      message is not written if it is the same as the command byte of the
+//      previous message in the track.  Meta and system-exclusive messages
+//      cancel the running status, so the command byte of the next channel
+//      message is always written after them.  Default is off.
+//
+
+void MidiFile::setRunningStatus(bool state) {
+	m_runningStatus = state;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::hasRunningStatus -- Returns true if channel messages are
+//      written with running status.
+//
+
+bool MidiFile::hasRunningStatus(void) const {
+	return m_runningStatus;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::scan -- Read the header and walk all track chunks of a
+//      Standard MIDI File, collecting track names, tempo and time
+//      signature changes, event and note counts and the file duration
+//      into a MidiFileSummary.  No MidiEvents are created, so this is
+//      much faster than read() followed by doTimeAnalysis() when only
+//      file statistics are needed.  Binasc input is not allowed.
+//
+
+bool MidiFile::scan(const std::string& filename, MidiFileSummary& summary) {
+	summary.clear();
+	std::fstream input;
+	input.open(filename.c_str(), std::ios::binary | std::ios::in);
+	if (!input.is_open()) {
+		return false;
+	}
+	return scan(input, summary);
+}
+
+//
+// istream version of MidiFile::scan().
+//
+
+bool MidiFile::scan(std::istream& input, MidiFileSummary& summary) {
+	std::vector<uchar> buffer;
+	if (!readAllBytes(input, buffer)) {
+		summary.clear();
+		return false;
+	}
+	return scan(buffer.data(), buffer.size(), summary);
+}
+
+//
+// Memory buffer version of MidiFile::scan().
+//
+
+bool MidiFile::scan(const uchar* data, size_t size, MidiFileSummary& summary) {
+	summary.clear();
+	const uchar* ptr = data;
+	const uchar* end = data + size;
+
+	SmfHeader header;
+	int status = SmfReader::readHeader(ptr, end, header);
+	if (status != SmfReader::SMF_OK) {
+		std::cerr << "Error: " << SmfReader::getErrorMessage(status) << std::endl;
+		return false;
+	}
+	int tpq = header.getTicksPerQuarterNote();
+	int tracks = header.tracks;
+
+	summary.type = header.type;
+	summary.trackCount = tracks;
+	summary.ticksPerQuarterNote = tpq;
+	summary.trackNames.resize(tracks);
+
+	for (int i=0; i<tracks; i++) {
+		ulong chunksize;
+		int absticks = 0;
+		status = SmfReader::readTrackStart(ptr, end, chunksize);
+		if (status == SmfReader::SMF_OK) {
+			status = SmfReader::readTrack(ptr, end,
+				[&summary, &absticks, i](const SmfMessage& message) {
+					summary.eventCount++;
+					absticks = message.tick;
+					if (((message.command & 0xf0) == 0x90) && (message.data[1] != 0)) {
+						summary.noteCount++;
+					}
+					if (!message.isMeta()) {
+						return true;
+					}
+					const uchar* ptr = message.data;
+					switch (message.metatype) {
+						case 0x03:   // track name
+							if (summary.trackNames[i].empty()) {
+								summary.trackNames[i].assign((const char*)ptr, message.size);
+							}
+							break;
+						case 0x51:   // tempo
+							if (message.size == 3) {
+								MidiFileSummary::TempoChange tempo;
+								tempo.tick = message.tick;
+								tempo.microseconds = (ptr[0] << 16) | (ptr[1] << 8) | ptr[2];
+								summary.tempos.push_back(tempo);
+							}
+							break;
+						case 0x58:   // time signature
+							if (message.size == 4) {
+								MidiFileSummary::TimeSignature timesig;
+								timesig.tick = message.tick;
+								timesig.top = ptr[0];
+								timesig.bottom = 1 << (ptr[1] & 0x1f);
+								summary.timeSignatures.push_back(timesig);
+							}
+							break;
+					}
+					return true;
+				});
+		}
+		if (status != SmfReader::SMF_OK) {
+			std::cerr << "Error: " << SmfReader::getErrorMessage(status)
+			     << " in track " << i << std::endl;
+			summary.clear();
+			return false;
+		}
+
+		if (absticks > summary.durationInTicks) {
+			summary.durationInTicks = absticks;
+		}
+	}
+
+	// Tempo changes are stored by track, so put them into time order
+	// (keeping track order for changes at the same tick, as in joinTracks())
+	// and then calculate the duration in seconds.
+	std::stable_sort(summary.tempos.begin(), summary.tempos.end(),
+		[](const MidiFileSummary::TempoChange& a,
+				const MidiFileSummary::TempoChange& b) {
+			return a.tick < b.tick;
+		});
+	std::stable_sort(summary.timeSignatures.begin(), summary.timeSignatures.end(),
+		[](const MidiFileSummary::TimeSignature& a,
+				const MidiFileSummary::TimeSignature& b) {
+			return a.tick < b.tick;
+		});
+
+	double secondsPerTick = 60.0 / (120.0 * tpq);
+	int lasttick = 0;
+	double seconds = 0.0;
+	for (auto& tempo : summary.tempos) {
+		if (tempo.tick > summary.durationInTicks) {
+			break;
+		}
+		seconds += (tempo.tick - lasttick) * secondsPerTick;
+		lasttick = tempo.tick;
+		secondsPerTick = tempo.microseconds / 1000000.0 / tpq;
+	}
+	seconds += (summary.durationInTicks - lasttick) * secondsPerTick;
+	summary.durationInSeconds = seconds;
+
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFileSummary::clear -- Reset all statistics.
+//
+
+void MidiFileSummary::clear(void) {
+	type                = 0;
+	trackCount          = 0;
+	ticksPerQuarterNote = 0;
+	eventCount          = 0;
+	noteCount           = 0;
+	durationInTicks     = 0;
+	durationInSeconds   = 0.0;
+	tempos.clear();
+	timeSignatures.clear();
+	trackNames.clear();
+}
+
+
+
 //////////////////////////////
 //
 // MidiFile::write -- write a standard MIDI file to a file or an output
-//    stream.
+//    stream.  The complete file is first encoded into a memory buffer and
+//    then written with a single call.  Writing does not modify the events
+//    (delta ticks are calculated while encoding), so several threads may
+//    write the same MidiFile at the same time as long as no thread is
+//    changing it.
 //
 
-bool MidiFile::write(const std::string& filename) {
-	std::fstream output(filename.c_str(), std::ios::binary | std::ios::out);
+bool MidiFile::write(const std::string& filename) const {
+	std::vector<uchar> buffer;
+	if (!write(buffer)) {
+		return false;
+	}
+
+	// Unbuffered, so that the file data is written with a single call.
+	std::fstream output;
+	output.rdbuf()->pubsetbuf(NULL, 0);
+	output.open(filename.c_str(), std::ios::binary | std::ios::out);
 
 	if (!output.is_open()) {
 		std::cerr << "Error: could not write: " << filename << std::endl;
 		return false;
 	}
-	m_rwstatus = write(output);
+	output.write((const char*)buffer.data(), buffer.size());
+	m_rwstatus = !output.fail();
 	output.close();
 	return m_rwstatus;
 }
@@ -569,110 +981,94 @@ bool MidiFile::write(const std::string& filename) {
 // ostream version of MidiFile::write().
 //
 
-bool MidiFile::write(std::ostream& out) {
-	int oldTimeState = getTickState();
-	if (oldTimeState == TIME_STATE_ABSOLUTE) {
-		makeDeltaTicks();
+bool MidiFile::write(std::ostream& out) const {
+	std::vector<uchar> buffer;
+	if (!write(buffer)) {
+		return false;
+	}
+	out.write((const char*)buffer.data(), buffer.size());
+	return true;
+}
+
+//
+// Memory version of MidiFile::write().  The Standard MIDI File is encoded
+// into the output buffer, which is sized for the complete file before
+// any data is written (previous contents are discarded, but the allocated
+// memory is reused).  Delta ticks are calculated while writing, so the
+// tick state of the tracks is not changed.  If more than one write thread
+// is set, the tracks are sized and encoded in parallel, each directly into
+// its own place in the output buffer.
+//
+
+bool MidiFile::write(std::vector<uchar>& output) const {
+	int trackcount = getNumTracks();
+	int threads = getThreadCount(m_writeThreads);
+
+	// Calculate the size of each track chunk, including the end-of-track
+	// message which is always written, so that the file size is exact.
+	std::vector<size_t> offsets(trackcount + 1);
+	offsets[0] = 14;
+	parallelFor(trackcount, threads, [&](int i) {
+		offsets[i+1] = getTrackChunkSize(i);
+	});
+	for (int i=0; i<trackcount; i++) {
+		offsets[i+1] += offsets[i];
 	}
+	output.resize(offsets[trackcount]);
+	uchar* ptr = output.data();
 
 	// write the header of the Standard MIDI File
-	char ch;
 	// 1. The characters "MThd"
-	ch = 'M'; out << ch;
-	ch = 'T'; out << ch;
-	ch = 'h'; out << ch;
-	ch = 'd'; out << ch;
+	*ptr++ = 'M';
+	*ptr++ = 'T';
+	*ptr++ = 'h';
+	*ptr++ = 'd';
 
 	// 2. write the size of the header (always a "6" stored in unsigned long
 	//    (4 bytes).
-	ulong longdata = 6;
-	writeBigEndianULong(out, longdata);
+	ptr = writeBigEndian(ptr, 6, 4);
 
 	// 3. MIDI file format, type 0, 1, or 2
-	ushort shortdata;
-	shortdata = static_cast<ushort>(getNumTracks() == 1 ? 0 : 1);
-	writeBigEndianUShort(out,shortdata);
+	ptr = writeBigEndian(ptr, trackcount == 1 ? 0 : 1, 2);
 
 	// 4. write out the number of tracks.
-	shortdata = static_cast<ushort>(getNumTracks());
-	writeBigEndianUShort(out, shortdata);
+	ptr = writeBigEndian(ptr, trackcount, 2);
 
 	// 5. write out the number of ticks per quarternote. (avoiding SMTPE for now)
-	shortdata = static_cast<ushort>(getTicksPerQuarterNote());
-	writeBigEndianUShort(out, shortdata);
-
-	// now write each track.
-	std::vector<uchar> trackdata;
-	uchar endoftrack[4] = {0, 0xff, 0x2f, 0x00};
-	int i, j, k;
-	int size;
-	for (i=0; i<getNumTracks(); i++) {
-		trackdata.reserve(123456);   // make the track data larger than
-		                             // expected data input
-		trackdata.clear();
-		for (j=0; j<(int)m_events[i]->size(); j++) {
-			if ((*m_events[i])[j].empty()) {
-				// Don't write empty m_events (probably a delete message).
-				continue;
-			}
-			if ((*m_events[i])[j].isEndOfTrack()) {
-				// Suppress end-of-track meta messages (one will be added
-				// automatically after all track data has been written).
-				continue;
-			}
-			writeVLValue((*m_events[i])[j].tick, trackdata);
-			if (((*m_events[i])[j].getCommandByte() == 0xf0) ||
-					((*m_events[i])[j].getCommandByte() == 0xf7)) {
-				// 0xf0 == Complete sysex message (0xf0 is part of the raw MIDI).
-				// 0xf7 == Raw byte message (0xf7 not part of the raw MIDI).
-				// Print the first byte of the message (0xf0 or 0xf7), then
-				// print a VLV length for the rest of the bytes in the message.
-				// In other words, when creating a 0xf0 or 0xf7 MIDI message,
-				// do not insert the VLV byte length yourself, as this code will
-				// do it for you automatically.
-				trackdata.push_back((*m_events[i])[j][0]); // 0xf0 or 0xf7;
-				writeVLValue(((int)(*m_events[i])[j].size())-1, trackdata);
-				for (k=1; k<(int)(*m_events[i])[j].size(); k++) {
-					trackdata.push_back((*m_events[i])[j][k]);
-				}
-			} else {
-				// non-sysex type of message, so just output the
-				// bytes of the message:
-				for (k=0; k<(int)(*m_events[i])[j].size(); k++) {
-					trackdata.push_back((*m_events[i])[j][k]);
-				}
-			}
-		}
-		size = (int)trackdata.size();
-		if ((size < 3) || !((trackdata[size-3] == 0xff)
-				&& (trackdata[size-2] == 0x2f))) {
-			trackdata.push_back(endoftrack[0]);
-			trackdata.push_back(endoftrack[1]);
-			trackdata.push_back(endoftrack[2]);
-			trackdata.push_back(endoftrack[3]);
-		}
+	ptr = writeBigEndian(ptr, getTicksPerQuarterNote(), 2);
 
-		// now ready to write to MIDI file.
+	// now write each track at its final position.
+	parallelFor(trackcount, threads, [&](int i) {
+		writeTrackChunk(i, output.data() + offsets[i]);
+	});
+	return true;
+}
 
-		// first write the track ID marker "MTrk":
-		ch = 'M'; out << ch;
-		ch = 'T'; out << ch;
-		ch = 'r'; out << ch;
-		ch = 'k'; out << ch;
 
-		// A. write the size of the MIDI data to follow:
-		longdata = (int)trackdata.size();
-		writeBigEndianULong(out, longdata);
 
-		// B. write the actual data
-		out.write((char*)trackdata.data(), trackdata.size());
-	}
+//////////////////////////////
+//
+// MidiFile::setWriteThreads -- Set the number of threads which encode the
+//     tracks of a file in write().  The default is 1, which encodes the
+//     tracks one after another in the calling thread.  A count of 0 uses
+//     one thread for each processor core.  Extra threads are only started
+//     for files with more than one track.
+//
 
-	if (oldTimeState == TIME_STATE_ABSOLUTE) {
-		makeAbsoluteTicks();
-	}
+void MidiFile::setWriteThreads(int count) {
+	m_writeThreads = count < 0 ? 1 : count;
+}
 
-	return true;
+
+
+//////////////////////////////
+//
+// MidiFile::getWriteThreads -- Return the number of threads used to encode
+//     tracks when writing (0 for one thread per processor core).
+//
+
+int MidiFile::getWriteThreads(void) const {
+	return m_writeThreads;
 }
 
 
@@ -685,7 +1081,7 @@ bool MidiFile::write(std::ostream& out) {
 //    Default value: width = 0
 //
 
-bool MidiFile::writeBase64(const std::string& filename, int width) {
+bool MidiFile::writeBase64(const std::string& filename, int width) const {
 	std::fstream output(filename.c_str(), std::ios::binary | std::ios::out);
 
 	if (!output.is_open()) {
@@ -698,27 +1094,15 @@ bool MidiFile::writeBase64(const std::string& filename, int width) {
 }
 
 
-bool MidiFile::writeBase64(std::ostream& out, int width) {
-	std::stringstream raw;
-	bool status = MidiFile::write(raw);
+bool MidiFile::writeBase64(std::ostream& out, int width) const {
+	std::vector<uchar> bytes;
+	bool status = MidiFile::write(bytes);
 	if (!status) {
 		return status;
 	}
-	std::string encoded = MidiFile::base64Encode(raw.str());
-	if (width <= 0) {
-		out << encoded;
-		return status;
-	}
-	int length = (int)encoded.size();
-	for (int i=0; i<length; i++) {
-		out << encoded[i];
-		if ((i + 1) % width == 0) {
-			out << "\n";
-		}
-	}
-	if ((length + 1) % width != 0) {
-		out << "\n";
-	}
+	std::vector<char> encoded(getBase64Size(bytes.size(), width));
+	base64Encode(bytes.data(), bytes.size(), encoded.data(), width);
+	out.write(encoded.data(), encoded.size());
 	return status;
 }
 
@@ -730,14 +1114,15 @@ bool MidiFile::writeBase64(std::ostream& out, int width) {
 //     Default value: width = 0
 //
 
-std::string MidiFile::getBase64(int width) {
-	std::stringstream output;
-	bool status = MidiFile::writeBase64(output, width);
+std::string MidiFile::getBase64(int width) const {
+	std::vector<uchar> bytes;
+	bool status = MidiFile::write(bytes);
 	if (!status) {
 		return "";
-	} else {
-		return output.str();
 	}
+	std::string output(getBase64Size(bytes.size(), width), '\0');
+	base64Encode(bytes.data(), bytes.size(), &output[0], width);
+	return output;
 }
 
 
@@ -752,7 +1137,7 @@ std::string MidiFile::getBase64(int width) {
 //  default value: width=25
 //
 
-bool MidiFile::writeHex(const std::string& filename, int width) {
+bool MidiFile::writeHex(const std::string& filename, int width) const {
 	std::fstream output(filename.c_str(), std::ios::out);
 	if (!output.is_open()) {
 		std::cerr << "Error: could not write: " << filename << std::endl;
@@ -767,14 +1152,14 @@ bool MidiFile::writeHex(const std::string& filename, int width) {
 // ostream version of MidiFile::writeHex().
 //
 
-bool MidiFile::writeHex(std::ostream& out, int width) {
-	std::stringstream tempstream;
-	MidiFile::write(tempstream);
-	int len = (int)tempstream.str().length();
+bool MidiFile::writeHex(std::ostream& out, int width) const {
+	std::vector<uchar> bytes;
+	MidiFile::write(bytes);
+	int len = (int)bytes.size();
 	int wordcount = 1;
 	int linewidth = width >= 0 ? width : 25;
 	for (int i=0; i<len; i++) {
-		int value = (unsigned char)tempstream.str()[i];
+		int value = bytes[i];
 		out << std::hex << std::setw(2) << std::setfill('0') << value;
 		if (linewidth) {
 			if (i < len - 1) {
@@ -802,7 +1187,7 @@ bool MidiFile::writeHex(std::ostream& out, int width) {
 //    the binasc format (ASCII version of the MIDI file).
 //
 
-bool MidiFile::writeBinasc(const std::string& filename) {
+bool MidiFile::writeBinasc(const std::string& filename) const {
 	std::fstream output(filename.c_str(), std::ios::out);
 
 	if (!output.is_open()) {
@@ -818,7 +1203,7 @@ bool MidiFile::writeBinasc(const std::string& filename) {
 // ostream version of MidiFile::writeBinasc().
 //
 
-bool MidiFile::writeBinasc(std::ostream& output) {
+bool MidiFile::writeBinasc(std::ostream& output) const {
 	std::stringstream binarydata;
 	m_rwstatus = write(binarydata);
 	if (m_rwstatus == false) {
@@ -841,7 +1226,7 @@ bool MidiFile::writeBinasc(std::ostream& output) {
 //    of the MIDI file), including commentary about the MIDI messages.
 //
 
-bool MidiFile::writeBinascWithComments(const std::string& filename) {
+bool MidiFile::writeBinascWithComments(const std::string& filename) const {
 	std::fstream output(filename.c_str(), std::ios::out);
 
 	if (!output.is_open()) {
@@ -857,7 +1242,7 @@ bool MidiFile::writeBinascWithComments(const std::string& filename) {
 // ostream version of MidiFile::writeBinascWithComments().
 //
 
-bool MidiFile::writeBinascWithComments(std::ostream& output) {
+bool MidiFile::writeBinascWithComments(std::ostream& output) const {
 	std::stringstream binarydata;
 	m_rwstatus = write(binarydata);
 	if (m_rwstatus == false) {
@@ -1013,13 +1398,24 @@ void MidiFile::clearSequence(int track) {
 //   tracks into separate units again.  The style of the
 //   MidiFile when read from a file is with tracks split.
 //   The original track index is stored in the MidiEvent::track
-//   variable.
+//   variable.  The tracks are merged in the order given by sortTracks(),
+//   without sorting all of the events again, since the tracks are
+//   normally already sorted.
 //
 
 void MidiFile::joinTracks(void) {
 	if (getTrackState() == TRACK_STATE_JOINED) {
 		return;
 	}
+	// In the split state the track of an event is the index of its list,
+	// since tracks which are moved by mergeTracks() or deleteTrack() are
+	// not renumbered, so store it in the events now.
+	for (int i=0; i<getNumTracks(); i++) {
+		MidiEventList& list = *m_events[i];
+		for (int j=0; j<list.size(); j++) {
+			list[j].track = i;
+		}
+	}
 	if (getNumTracks() == 1) {
 		m_theTrackState = TRACK_STATE_JOINED;
 		return;
@@ -1030,8 +1426,7 @@ void MidiFile::joinTracks(void) {
 
 	int messagesum = 0;
 	int length = getNumTracks();
-	int i, j;
-	for (i=0; i<length; i++) {
+	for (int i=0; i<length; i++) {
 		messagesum += (*m_events[i]).size();
 	}
 	joinedTrack->reserve((int)(messagesum + 32 + messagesum * 0.1));
@@ -1040,18 +1435,14 @@ void MidiFile::joinTracks(void) {
 	if (oldTimeState == TIME_STATE_DELTA) {
 		makeAbsoluteTicks();
 	}
-	for (i=0; i<length; i++) {
-		for (j=0; j<(int)m_events[i]->size(); j++) {
-			joinedTrack->push_back_no_copy(&(*m_events[i])[j]);
-		}
-	}
+
+	mergeEventLists(m_events, *joinedTrack);
 
 	clear_no_deallocate();
 
 	delete m_events[0];
 	m_events.resize(0);
 	m_events.push_back(joinedTrack);
-	sortTracks();
 	if (oldTimeState == TIME_STATE_DELTA) {
 		makeDeltaTicks();
 	}
@@ -1101,6 +1492,9 @@ void MidiFile::splitTracks(void) {
 		int trackValue = (*olddata)[i].track;
 		m_events[trackValue]->push_back_no_copy(&(*olddata)[i]);
 	}
+	for (i=0; i<trackCount; i++) {
+		m_events[i]->shareBlocks(*olddata);
+	}
 
 	olddata->detach();
 	delete olddata;
@@ -1170,6 +1564,9 @@ void MidiFile::splitTracksByChannel(void) {
 		}
 		m_events[trackValue]->push_back_no_copy(&eventlist[i]);
 	}
+	for (i=0; i<trackCount; i++) {
+		m_events[i]->shareBlocks(*olddata);
+	}
 
 	olddata->detach();
 	delete olddata;
@@ -1290,6 +1687,7 @@ void MidiFile::makeDeltaTicks(void) {
 			(*m_events[i])[j].tick = deltatick;
 			timedata[i] = temp;
 		}
+		m_events[i]->clearTickIndex();
 	}
 	m_theTimeState = TIME_STATE_DELTA;
 	delete [] timedata;
@@ -1333,6 +1731,7 @@ void MidiFile::makeAbsoluteTicks(void) {
 			timedata[i] += (*m_events[i])[j].tick;
 			(*m_events[i])[j].tick = timedata[i];
 		}
+		m_events[i]->clearTickIndex();
 	}
 	m_theTimeState = TIME_STATE_ABSOLUTE;
 	delete [] timedata;
@@ -1488,7 +1887,8 @@ void MidiFile::doTimeAnalysis(void) {
 //////////////////////////////
 //
 // MidiFile::getTimeInSeconds -- return the time in seconds for
-//     the current message.
+//     the current message.  The time is interpolated from the tempo
+//     segments of the time map, which are found with a binary search.
 //
 
 double MidiFile::getTimeInSeconds(int aTrack, int anIndex) {
@@ -1497,30 +1897,49 @@ double MidiFile::getTimeInSeconds(int aTrack, int anIndex) {
 
 
 double MidiFile::getTimeInSeconds(int tickvalue) {
-	if (m_timemapvalid == 0) {
-		buildTimeMap();
-		if (m_timemapvalid == 0) {
-			return -1.0;    // something went wrong
-		}
-	}
+	return linearSecondInterpolationAtTick(tickvalue);
+}
 
-	_TickTime key;
-	key.tick    = tickvalue;
-	key.seconds = -1;
 
-	void* ptr = bsearch(&key, m_timemap.data(), m_timemap.size(),
-			sizeof(_TickTime), ticksearch);
+//
+// MidiFile::getTimeInSeconds -- Convert a list of tick values to seconds,
+//     with the same results as converting them one at a time (-1.0 for
+//     ticks outside of the file).  When the ticks are in increasing order,
+//     the time map is followed with one cursor instead of being searched
+//     for each tick, so the conversion takes time proportional to the
+//     number of ticks plus the number of tempo changes.  Ticks which go
+//     back in time are still converted, with a new search of the map.
+//
 
-	if (ptr == NULL) {
-		// The specific tick value was not found, so do a linear
-		// search for the two tick values which occur before and
-		// after the tick value, and do a linear interpolation of
-		// the time in seconds values to figure out the final
-		// time in seconds.
-		// Since the code is not yet written, kill the program at this point:
-		return linearSecondInterpolationAtTick(tickvalue);
-	} else {
-		return ((_TickTime*)ptr)->seconds;
+void MidiFile::getTimeInSeconds(const int* ticks, size_t count,
+		double* seconds) {
+	if (m_timemapvalid == 0) {
+		buildTimeMap();
+	}
+	if ((m_timemapvalid == 0) || m_timemap.empty()) {
+		std::fill(seconds, seconds + count, -1.0);
+		return;
+	}
+	int first = m_timemap.front().tick;
+	int last  = m_timemap.back().tick;
+	int lastindex = (int)m_timemap.size() - 1;
+	int k = 0;
+	for (size_t i=0; i<count; i++) {
+		int tick = ticks[i];
+		if ((tick < 0) || (tick < first) || (tick > last)) {
+			seconds[i] = -1.0;
+			continue;
+		}
+		if (tick < m_timemap[k].tick) {
+			k = (int)(std::upper_bound(m_timemap.begin(), m_timemap.end(), tick,
+				[](int value, const _TickTime& entry) {
+					return value < entry.tick;
+				}) - m_timemap.begin()) - 1;
+		}
+		while ((k < lastindex) && (m_timemap[k+1].tick <= tick)) {
+			k++;
+		}
+		seconds[i] = interpolateSecondsAtTick(k, tick);
 	}
 }
 
@@ -1530,34 +1949,53 @@ double MidiFile::getTimeInSeconds(int tickvalue) {
 //
 // MidiFile::getAbsoluteTickTime -- return the tick value represented
 //    by the input time in seconds.  If there is not tick entry at
-//    the given time in seconds, then interpolate between two values.
+//    the given time in seconds, then interpolate between two values
+//    (the entries are found with a binary search).
 //
 
 double MidiFile::getAbsoluteTickTime(double starttime) {
-	if (m_timemapvalid == 0) {
-		buildTimeMap();
-		if (m_timemapvalid == 0) {
-			return -1.0;    // something went wrong
-		}
-	}
+	return linearTickInterpolationAtSecond(starttime);
+}
 
-	_TickTime key;
-	key.tick    = -1;
-	key.seconds = starttime;
 
-	void* ptr = bsearch(&key, m_timemap.data(), m_timemap.size(),
-			sizeof(_TickTime), secondsearch);
+//
+// MidiFile::getAbsoluteTickTime -- Convert a list of times in seconds to
+//    tick values, with the same results as converting them one at a time
+//    (-1.0 for times outside of the file).  Times in increasing order are
+//    converted by following the time map with one cursor (see the list
+//    version of getTimeInSeconds()).
+//
 
-	if (ptr == NULL) {
-		// The specific seconds value was not found, so do a linear
-		// search for the two time values which occur before and
-		// after the given time value, and do a linear interpolation of
-		// the time in tick values to figure out the final time in ticks.
-		return linearTickInterpolationAtSecond(starttime);
-	} else {
-		return ((_TickTime*)ptr)->tick;
+void MidiFile::getAbsoluteTickTime(const double* seconds, size_t count,
+		double* ticks) {
+	if (m_timemapvalid == 0) {
+		buildTimeMap();
+	}
+	if ((m_timemapvalid == 0) || m_timemap.empty()) {
+		std::fill(ticks, ticks + count, -1.0);
+		return;
+	}
+	double first = m_timemap.front().seconds;
+	double last  = m_timemap.back().seconds;
+	int lastindex = (int)m_timemap.size() - 1;
+	int k = 0;
+	for (size_t i=0; i<count; i++) {
+		double time = seconds[i];
+		if ((time < 0.0) || (time < first) || (time > last)) {
+			ticks[i] = -1.0;
+			continue;
+		}
+		if (time < m_timemap[k].seconds) {
+			k = (int)(std::upper_bound(m_timemap.begin(), m_timemap.end(), time,
+				[](double value, const _TickTime& entry) {
+					return value < entry.seconds;
+				}) - m_timemap.begin()) - 1;
+		}
+		while ((k < lastindex) && (m_timemap[k+1].seconds <= time)) {
+			k++;
+		}
+		ticks[i] = interpolateTickAtSecond(k, time);
 	}
-
 }
 
 
@@ -1587,6 +2025,34 @@ int MidiFile::linkNotePairs(void) {
 	return sum;
 }
 
+
+//
+// MidiFile::linkNotePairs -- Link note pairs of the tracks in parallel with
+//     the given number of threads (0 for one thread per processor core).
+//     Notes are only linked within a track, so each track is handled by one
+//     thread with its own note-on stacks.  Returns the total number of note
+//     message pairs that were linked.  Old links are cleared beforehand in
+//     the calling thread, since they may point to events in other tracks
+//     (such as after linking a joined file and splitting it again).
+//
+
+int MidiFile::linkNotePairs(int threads) {
+	clearLinks();
+	int trackcount = getTrackCount();
+	std::vector<int> counts(trackcount, 0);
+	parallelFor(trackcount, getThreadCount(threads), [&](int i) {
+		if (m_events[i] != NULL) {
+			counts[i] = m_events[i]->linkNotePairs();
+		}
+	});
+	int sum = 0;
+	for (int i=0; i<trackcount; i++) {
+		sum += counts[i];
+	}
+	m_linkedEventsQ = true;
+	return sum;
+}
+
 //
 // MidiFile::linkEventPairs -- Alias for MidiFile::linkNotePairs().
 //
@@ -1681,6 +2147,56 @@ MidiEvent* MidiFile::addEvent(int aTrack, MidiEvent& mfevent) {
 
 
 
+//////////////////////////////
+//
+// MidiFile::insertEvent -- Add a copy of an event to a track at its sorted
+//    position, so that the track does not need to be sorted afterwards
+//    (see MidiEventList::insertSorted()).  Sorted insertion is only done in
+//    absolute tick mode; in delta tick mode the event is appended.
+//
+
+MidiEvent* MidiFile::insertEvent(int aTrack, MidiEvent& mfevent) {
+	if (m_theTimeState != TIME_STATE_ABSOLUTE) {
+		std::cerr << "Warning: Sorted insertion only allowed in absolute tick mode."
+		          << std::endl;
+		return addEvent(aTrack, mfevent);
+	}
+	m_timemapvalid = 0;
+	MidiEventList& list = *m_events.at(getTrackState() == TRACK_STATE_JOINED ?
+			0 : aTrack);
+	int index = list.insertSorted(mfevent);
+	list[index].track = aTrack;
+	return &list[index];
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::insertEvents -- Add copies of a batch of events to a track at
+//    their sorted positions, merging them into the track in one pass
+//    instead of sorting the whole track.  The track of each added copy is
+//    set to aTrack (the events in the batch are not changed).  In delta
+//    tick mode the events are appended.
+//
+
+void MidiFile::insertEvents(int aTrack, const std::vector<MidiEvent>& events) {
+	if (m_theTimeState != TIME_STATE_ABSOLUTE) {
+		std::cerr << "Warning: Sorted insertion only allowed in absolute tick mode."
+		          << std::endl;
+		for (int i=0; i<(int)events.size(); i++) {
+			MidiEvent event = events[i];
+			addEvent(aTrack, event);
+		}
+		return;
+	}
+	m_timemapvalid = 0;
+	m_events.at(getTrackState() == TRACK_STATE_JOINED ? 0 : aTrack)->
+			insertSorted(events, aTrack);
+}
+
+
+
 ///////////////////////////////
 //
 // MidiFile::addMetaEvent --
@@ -1919,37 +2435,7 @@ int MidiFile::makeVLV(uchar *buffer, int number) {
 		return 1;
 	}
 
-	buffer[0] = (value >> 21) & 0x7f;
-	buffer[1] = (value >> 14) & 0x7f;
-	buffer[2] = (value >>  7) & 0x7f;
-	buffer[3] = (value >>  0) & 0x7f;
-
-	int i;
-	int flag = 0;
-	int length = -1;
-	for (i=0; i<3; i++) {
-		if (buffer[i] != 0) {
-			flag = 1;
-		}
-		if (flag) {
-			buffer[i] |= 0x80;
-		}
-		if (length == -1 && buffer[i] >= 0x80) {
-			length = 4-i;
-		}
-	}
-
-	if (length == -1) {
-		length = 1;
-	}
-
-	if (length < 4) {
-		for (i=0; i<length; i++) {
-			buffer[i] = buffer[4-length+i];
-		}
-	}
-
-	return length;
+	return Vlv::encode(value, buffer);
 }
 
 
@@ -2285,6 +2771,7 @@ void MidiFile::clear(void) {
 	m_timemap.clear();
 	m_theTrackState = TRACK_STATE_SPLIT;
 	m_theTimeState = TIME_STATE_ABSOLUTE;
+	std::vector<uchar>().swap(m_rawdata);
 }
 
 
@@ -2356,6 +2843,63 @@ int MidiFile::getNumEvents(int aTrack) const {
 
 
 
+//////////////////////////////
+//
+// MidiFile::getTickRange -- Find the events in a track with an absolute
+//   tick from starttick up to (but not including) endtick: the events from
+//   startindex to endindex-1.  The track must be sorted.  The range is found
+//   with a binary search (see MidiEventList::getTickRange()); if the
+//   MidiFile is in delta tick mode, then temporarily go into absolute tick
+//   mode, which takes time proportional to the size of the file.  Returns
+//   false (with an empty range) if the track does not exist or is not
+//   sorted.  The tick order is remembered until the track is changed with
+//   the functions of MidiFile or MidiEventList, so call markTicksChanged()
+//   or sortTracks() after assigning ticks to events directly.
+//
+
+bool MidiFile::getTickRange(int aTrack, int starttick, int endtick,
+		int& startindex, int& endindex) {
+	startindex = 0;
+	endindex = 0;
+	if ((aTrack < 0) || (aTrack >= getTrackCount())) {
+		std::cerr << "Error: track " << aTrack << " does not exist." << std::endl;
+		return false;
+	}
+	bool revertToDelta = false;
+	if (isDeltaTicks()) {
+		makeAbsoluteTicks();
+		revertToDelta = true;
+	}
+	bool output = m_events[aTrack]->getTickRange(starttick, endtick,
+			startindex, endindex);
+	if (revertToDelta) {
+		deltaTicks();
+	}
+	return output;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::markTicksChanged -- Notify the MidiFile that ticks have been
+//   assigned to events directly (such as with m[track][i].tick = 10), so
+//   that the stored tick order of the track (or of all tracks if the
+//   track is negative), which is used by getTickRange() and insertEvent(),
+//   and the tempo map used by the time functions are checked again.
+//
+
+void MidiFile::markTicksChanged(int aTrack) {
+	m_timemapvalid = 0;
+	for (int i=0; i<getTrackCount(); i++) {
+		if ((aTrack < 0) || (aTrack == i)) {
+			m_events[i]->clearTickIndex();
+		}
+	}
+}
+
+
+
 //////////////////////////////
 //
 // MidiFile::mergeTracks -- combine the data from two
@@ -2363,40 +2907,83 @@ int MidiFile::getNumEvents(int aTrack) const {
 //   track location listed, and Moving the other tracks
 //   in the file around to fill in the spot where Track2
 //   used to be.  The results of this function call cannot
-//   be reversed.
+//   be reversed.  The events are moved rather than copied (so links
+//   between events are kept), and the tracks are merged in sorted order
+//   without sorting all of the events again.  The MidiEvent::track
+//   values of the merged events are set to the index of the merged
+//   track, but the events of the other tracks which move keep their
+//   values, so that only the track lists are moved (see joinTracks()).
 //
 
 void MidiFile::mergeTracks(int aTrack1, int aTrack2) {
-	MidiEventList* mergedTrack;
-	mergedTrack = new MidiEventList;
+	std::vector<int> tracks = {aTrack1, aTrack2};
+	mergeTracks(tracks);
+}
+
+//
+// Version of mergeTracks() which merges any number of tracks in one pass.
+// The merged track is placed at the first track listed, and the other
+// tracks listed are removed.  Merging tracks one pair at a time would
+// move the later tracks once for each pair.
+//
+
+void MidiFile::mergeTracks(const std::vector<int>& tracks) {
+	int length = getNumTracks();
+	std::vector<int> merging;
+	std::vector<bool> removed(length, false);
+	for (int i=0; i<(int)tracks.size(); i++) {
+		if ((tracks[i] < 0) || (tracks[i] >= length)) {
+			std::cerr << "Error: track " << tracks[i] << " does not exist." << std::endl;
+			return;
+		}
+		if (std::find(merging.begin(), merging.end(), tracks[i]) == merging.end()) {
+			merging.push_back(tracks[i]);
+		}
+	}
+	if (merging.size() < 2) {
+		return;
+	}
+
 	int oldTimeState = getTickState();
 	if (oldTimeState == TIME_STATE_DELTA) {
 		makeAbsoluteTicks();
 	}
-	int length = getNumTracks();
-	for (int i=0; i<(int)m_events[aTrack1]->size(); i++) {
-		mergedTrack->push_back((*m_events[aTrack1])[i]);
+
+	// index of the merged track after the other tracks are removed:
+	int target = merging[0];
+	int newtarget = target;
+	for (int i=1; i<(int)merging.size(); i++) {
+		removed[merging[i]] = true;
+		newtarget -= merging[i] < target;
 	}
-	for (int j=0; j<(int)m_events[aTrack2]->size(); j++) {
-		(*m_events[aTrack2])[j].track = aTrack1;
-		mergedTrack->push_back((*m_events[aTrack2])[j]);
+	int messagesum = 0;
+	std::vector<MidiEventList*> lists;
+	for (int i=0; i<(int)merging.size(); i++) {
+		MidiEventList& list = *m_events[merging[i]];
+		for (int j=0; j<list.size(); j++) {
+			list[j].track = newtarget;
+		}
+		messagesum += list.size();
+		lists.push_back(&list);
 	}
 
-	mergedTrack->sort();
-
-	delete m_events[aTrack1];
-
-	m_events[aTrack1] = mergedTrack;
+	MidiEventList* mergedTrack = new MidiEventList;
+	mergedTrack->reserve(messagesum);
+	mergeEventLists(lists, *mergedTrack);
+	for (int i=0; i<(int)lists.size(); i++) {
+		lists[i]->detach();
+		delete lists[i];
+	}
+	m_events[target] = mergedTrack;
 
-	for (int i=aTrack2; i<length-1; i++) {
-		m_events[i] = m_events[i+1];
-		for (int j=0; j<(int)m_events[i]->size(); j++) {
-			(*m_events[i])[j].track = i;
+	// Remove the other merged tracks.
+	int count = 0;
+	for (int i=0; i<length; i++) {
+		if (!removed[i]) {
+			m_events[count++] = m_events[i];
 		}
 	}
-
-	m_events[length-1] = NULL;
-	m_events.resize(length-1);
+	m_events.resize(count);
 
 	if (oldTimeState == TIME_STATE_DELTA) {
 		deltaTicks();
@@ -2530,7 +3117,8 @@ void MidiFile::clearLinks(void) {
 //////////////////////////////
 //
 // MidiFile::linearTickInterpolationAtSecond -- return the tick value at the
-//    given input time.
+//    given input time.  The two entries of the time map around the time
+//    are found with a binary search.
 //
 
 double MidiFile::linearTickInterpolationAtSecond(double seconds) {
@@ -2541,56 +3129,26 @@ double MidiFile::linearTickInterpolationAtSecond(double seconds) {
 		}
 	}
 
-	int i;
-	double lasttime = m_timemap[m_timemap.size()-1].seconds;
 	// give an error value of -1 if time is out of range of data.
-	if (seconds < 0.0) {
+	if (m_timemap.empty()) {
 		return -1.0;
 	}
-	if (seconds > m_timemap[m_timemap.size()-1].seconds) {
-		return -1.0;
-	}
-
-	// Guess which side of the list is closest to target:
-	// Could do a more efficient algorithm since time values are sorted,
-	// but good enough for now...
-	int startindex = -1;
-	if (seconds < lasttime / 2) {
-		for (i=0; i<(int)m_timemap.size(); i++) {
-			if (m_timemap[i].seconds > seconds) {
-				startindex = i-1;
-				break;
-			} else if (m_timemap[i].seconds == seconds) {
-				startindex = i;
-				break;
-			}
-		}
-	} else {
-		for (i=(int)m_timemap.size()-1; i>0; i--) {
-			if (m_timemap[i].seconds < seconds) {
-				startindex = i+1;
-				break;
-			} else if (m_timemap[i].seconds == seconds) {
-				startindex = i;
-				break;
-			}
-		}
-	}
-
-	if (startindex < 0) {
+	if (seconds < 0.0) {
 		return -1.0;
 	}
-	if (startindex >= (int)m_timemap.size()-1) {
+	if (seconds > m_timemap.back().seconds) {
 		return -1.0;
 	}
 
-	double x1 = m_timemap[startindex].seconds;
-	double x2 = m_timemap[startindex+1].seconds;
-	double y1 = m_timemap[startindex].tick;
-	double y2 = m_timemap[startindex+1].tick;
-	double xi = seconds;
-
-	return (xi-x1) * ((y2-y1)/(x2-x1)) + y1;
+	// find the last entry at or before the given time:
+	auto next = std::upper_bound(m_timemap.begin(), m_timemap.end(), seconds,
+		[](double value, const _TickTime& entry) {
+			return value < entry.seconds;
+		});
+	if (next == m_timemap.begin()) {
+		return -1.0;
+	}
+	return interpolateTickAtSecond((int)(next - m_timemap.begin()) - 1, seconds);
 }
 
 
@@ -2599,6 +3157,8 @@ double MidiFile::linearTickInterpolationAtSecond(double seconds) {
 //
 // MidiFile::linearSecondInterpolationAtTick -- return the time in seconds
 //    value at the given input tick time. (Ticks input could be made double).
+//    The two entries of the time map around the tick are found with a
+//    binary search.
 //
 
 double MidiFile::linearSecondInterpolationAtTick(int ticktime) {
@@ -2609,9 +3169,10 @@ double MidiFile::linearSecondInterpolationAtTick(int ticktime) {
 		}
 	}
 
-	int i;
-	double lasttick = m_timemap[m_timemap.size()-1].tick;
 	// give an error value of -1 if time is out of range of data.
+	if (m_timemap.empty()) {
+		return -1;
+	}
 	if (ticktime < 0.0) {
 		return -1;
 	}
@@ -2619,39 +3180,51 @@ double MidiFile::linearSecondInterpolationAtTick(int ticktime) {
 		return -1;  // don't try to extrapolate
 	}
 
-	// Guess which side of the list is closest to target:
-	// Could do a more efficient algorithm since time values are sorted,
-	// but good enough for now...
-	int startindex = -1;
-	if (ticktime < lasttick / 2) {
-		for (i=0; i<(int)m_timemap.size(); i++) {
-			if (m_timemap[i].tick > ticktime) {
-				startindex = i-1;
-				break;
-			} else if (m_timemap[i].tick == ticktime) {
-				startindex = i;
-				break;
-			}
-		}
-	} else {
-		for (i=(int)m_timemap.size()-1; i>0; i--) {
-			if (m_timemap[i].tick < ticktime) {
-				startindex = i;
-				break;
-			} else if (m_timemap[i].tick == ticktime) {
-				startindex = i;
-				break;
-			}
-		}
-	}
-
-	if (startindex < 0) {
+	// find the last entry at or before the given tick:
+	auto next = std::upper_bound(m_timemap.begin(), m_timemap.end(), ticktime,
+		[](int value, const _TickTime& entry) {
+			return value < entry.tick;
+		});
+	if (next == m_timemap.begin()) {
 		return -1;
 	}
-	if (startindex >= (int)m_timemap.size()-1) {
-		return -1;
+	return interpolateSecondsAtTick((int)(next - m_timemap.begin()) - 1,
+			ticktime);
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::interpolateTickAtSecond -- return the tick value at the given
+//    time, which is between the time map entries at startindex and
+//    startindex+1 (or at the entry at startindex).
+//
+
+double MidiFile::interpolateTickAtSecond(int startindex, double seconds) const {
+	if (m_timemap[startindex].seconds == seconds) {
+		return m_timemap[startindex].tick;
 	}
 
+	double x1 = m_timemap[startindex].seconds;
+	double x2 = m_timemap[startindex+1].seconds;
+	double y1 = m_timemap[startindex].tick;
+	double y2 = m_timemap[startindex+1].tick;
+	double xi = seconds;
+
+	return (xi-x1) * ((y2-y1)/(x2-x1)) + y1;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::interpolateSecondsAtTick -- return the time in seconds at the
+//    given tick, which is between the time map entries at startindex and
+//    startindex+1 (or at the entry at startindex).
+//
+
+double MidiFile::interpolateSecondsAtTick(int startindex, int ticktime) const {
 	if (m_timemap[startindex].tick == ticktime) {
 		return m_timemap[startindex].seconds;
 	}
@@ -2680,332 +3253,480 @@ double MidiFile::linearSecondInterpolationAtTick(int ticktime) {
 //      is the only mode tested (25 frames per second and 40 subframes
 //      per frame).
 //
+//      The map only stores the tick/seconds points where the tempo
+//      changes, plus the first and last tick of the file, since the
+//      time is linear between them.  Only the tempo messages are
+//      collected and sorted (in the order of joinTracks() for tempos at
+//      the same tick, so that the last one is used); the seconds of all
+//      events are then filled in with one pass through each track, and
+//      the tracks are not joined or converted to absolute ticks.
+//
 
 void MidiFile::buildTimeMap(void) {
+	struct TempoChange {
+		int    tick;
+		int    track;
+		int    index;
+		double spt;
+	};
+	std::vector<TempoChange> tempos;
 
-	// convert the MIDI file to absolute time representation
-	// in single track mode (and undo if the MIDI file was not
-	// in that state when this function was called.
-	//
-	int trackstate = getTrackState();
-	int timestate  = getTickState();
-
-	makeAbsoluteTicks();
-	joinTracks();
-
-	int allocsize = getNumEvents(0);
-	m_timemap.reserve(allocsize+10);
 	m_timemap.clear();
-
-	_TickTime value;
-
-	int lasttick = 0;
-	int tickinit = 0;
-
-	int i;
+	bool delta = getTickState() == TIME_STATE_DELTA;
 	int tpq = getTicksPerQuarterNote();
+	int mintick = 0;
+	int maxtick = 0;
+	bool found = false;
+	for (int i=0; i<getTrackCount(); i++) {
+		const MidiEventList& list = *m_events[i];
+		int tick = 0;
+		for (int j=0; j<list.size(); j++) {
+			tick = delta ? tick + list[j].tick : list[j].tick;
+			if (!found || (tick < mintick)) {
+				mintick = tick;
+			}
+			if (!found || (tick > maxtick)) {
+				maxtick = tick;
+			}
+			found = true;
+			if (list[j].isTempo()) {
+				TempoChange tempo;
+				tempo.tick  = tick;
+				tempo.track = i;
+				tempo.index = j;
+				tempo.spt   = list[j].getTempoSPT(tpq);
+				tempos.push_back(tempo);
+			}
+		}
+	}
+	if (!found) {
+		m_timemapvalid = 1;
+		return;
+	}
+	std::sort(tempos.begin(), tempos.end(),
+		[](const TempoChange& a, const TempoChange& b) {
+			if (a.tick != b.tick) {
+				return a.tick < b.tick;
+			}
+			if (a.track != b.track) {
+				return a.track < b.track;
+			}
+			return a.index < b.index;
+		});
+
+	// segmentspt == seconds per tick after each point of the map.
+	std::vector<double> segmentspt;
 	double defaultTempo = 120.0;
 	double secondsPerTick = 60.0 / (defaultTempo * tpq);
-
-	double lastsec = 0.0;
-	double cursec = 0.0;
-
-	for (i=0; i<getNumEvents(0); i++) {
-		int curtick = getEvent(0, i).tick;
-		getEvent(0, i).seconds = cursec;
-		if ((curtick > lasttick) || !tickinit) {
-			tickinit = 1;
-
-			// calculate the current time in seconds:
-			cursec = lastsec + (curtick - lasttick) * secondsPerTick;
-			getEvent(0, i).seconds = cursec;
-
-			// store the new tick to second mapping
-			value.tick = curtick;
-			value.seconds = cursec;
+	_TickTime value;
+	value.tick    = mintick;
+	value.seconds = mintick * secondsPerTick;
+	m_timemap.push_back(value);
+	for (int i=0; i<(int)tempos.size(); i++) {
+		if (tempos[i].tick > m_timemap.back().tick) {
+			value.seconds = m_timemap.back().seconds +
+					(tempos[i].tick - m_timemap.back().tick) * secondsPerTick;
+			value.tick = tempos[i].tick;
+			segmentspt.push_back(secondsPerTick);
 			m_timemap.push_back(value);
-			lasttick   = curtick;
-			lastsec    = cursec;
 		}
+		secondsPerTick = tempos[i].spt;
+	}
+	if (maxtick > m_timemap.back().tick) {
+		value.seconds = m_timemap.back().seconds +
+				(maxtick - m_timemap.back().tick) * secondsPerTick;
+		value.tick = maxtick;
+		segmentspt.push_back(secondsPerTick);
+		m_timemap.push_back(value);
+	}
+	segmentspt.push_back(secondsPerTick);
 
-		// update the tempo if needed:
-		if (getEvent(0,i).isTempo()) {
-			secondsPerTick = getEvent(0,i).getTempoSPT(getTicksPerQuarterNote());
+	// Fill in the time of each event, moving forward through the map
+	// (and searching for the segment again if a track is not sorted).
+	int last = (int)m_timemap.size() - 1;
+	for (int i=0; i<getTrackCount(); i++) {
+		MidiEventList& list = *m_events[i];
+		int tick = 0;
+		int k = 0;
+		for (int j=0; j<list.size(); j++) {
+			tick = delta ? tick + list[j].tick : list[j].tick;
+			if (tick < m_timemap[k].tick) {
+				k = (int)(std::upper_bound(m_timemap.begin(), m_timemap.end(), tick,
+						[](int t, const _TickTime& point) {
+							return t < point.tick;
+						}) - m_timemap.begin()) - 1;
+			}
+			while ((k < last) && (m_timemap[k+1].tick <= tick)) {
+				k++;
+			}
+			list[j].seconds = m_timemap[k].seconds +
+					(tick - m_timemap[k].tick) * segmentspt[k];
 		}
 	}
 
-	// reset the states of the tracks or time values if necessary here:
-	if (timestate == TIME_STATE_DELTA) {
-		deltaTicks();
+	m_timemapvalid = 1;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::getEventType -- Return the EVENT_TYPE_* bit for a message
+//      with the given command byte (and meta type for 0xff messages).
+//      End-of-track messages return 0 since they cannot be filtered.
+//
+
+int MidiFile::getEventType(uchar command, uchar metatype) {
+	switch (command & 0xf0) {
+		case 0x80:
+		case 0x90: return EVENT_TYPE_NOTE;
+		case 0xa0: return EVENT_TYPE_AFTERTOUCH;
+		case 0xb0: return EVENT_TYPE_CONTROLLER;
+		case 0xc0: return EVENT_TYPE_PATCH;
+		case 0xd0: return EVENT_TYPE_PRESSURE;
+		case 0xe0: return EVENT_TYPE_PITCHBEND;
+	}
+	if (command != 0xff) {
+		return EVENT_TYPE_SYSEX;
+	}
+	switch (metatype) {
+		case 0x2f: return 0;
+		case 0x51: return EVENT_TYPE_TEMPO;
+		case 0x58: return EVENT_TYPE_TIMESIG;
+		case 0x59: return EVENT_TYPE_KEYSIG;
 	}
-	if (trackstate == TRACK_STATE_SPLIT) {
-		splitTracks();
+	if ((metatype >= 0x01) && (metatype <= 0x0f)) {
+		return EVENT_TYPE_TEXT;
 	}
+	return EVENT_TYPE_META;
+}
 
-	m_timemapvalid = 1;
 
+
+//////////////////////////////
+//
+// MidiFile::isFilteredEvent -- Returns true if the read filter mask
+//      excludes the given message type.
+//
+
+bool MidiFile::isFilteredEvent(uchar command, uchar metatype) const {
+	if (m_readFilter == EVENT_TYPE_ALL) {
+		return false;
+	}
+	int type = getEventType(command, metatype);
+	return type && !(m_readFilter & type);
 }
 
 
 
 //////////////////////////////
 //
-// MidiFile::extractMidiData -- Extract MIDI data from input
-//    stream.  Return value is 0 if failure; otherwise, returns 1.
+// MidiFile::getVlvValue -- Return a delta tick value limited to the
+//    largest number which can be stored as a VLV in a MIDI file
+//    (0x0FFFffff).
 //
 
-int MidiFile::extractMidiData(std::istream& input, std::vector<uchar>& array,
-	uchar& runningCommand) {
+ulong MidiFile::getVlvValue(long value) {
+	if ((unsigned long)value >= (1 << 28)) {
+		return 0x0FFFffff;
+	}
+	return (ulong)value;
+}
 
-	int character;
-	uchar byte;
-	array.clear();
-	int runningQ;
 
-	character = input.get();
-	if (character == EOF) {
-		std::cerr << "Error: unexpected end of file." << std::endl;
-		return 0;
-	} else {
-		byte = (uchar)character;
+
+//////////////////////////////
+//
+// MidiFile::getSysexLength -- Return the length which is written after
+//    the 0xf0 or 0xf7 byte of a sysex message (the size of the rest of
+//    the message, including a payload view).
+//
+
+ulong MidiFile::getSysexLength(const MidiEvent& event) {
+	return event.size() - 1;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::writeBigEndian -- Store the given number of low bytes of a
+//    value in big-endian order.  Returns the position after the bytes.
+//
+
+uchar* MidiFile::writeBigEndian(uchar* ptr, ulong value, int bytes) {
+	for (int i=bytes-1; i>=0; i--) {
+		*ptr++ = (uchar)((value >> (8 * i)) & 0xff);
 	}
+	return ptr;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::mergeEventLists -- Store the events of several lists in an
+//    empty output list (without copying them), in the order which sorting
+//    all of the events together with MidiEventList::sort() would give.  The
+//    input lists are not changed, and they are normally already sorted,
+//    in which case this takes O(N log k) time for N events in k lists.
+//    The ticks must be absolute.
+//
+
+void MidiFile::mergeEventLists(const std::vector<MidiEventList*>& lists,
+		MidiEventList& output) {
+	int length = (int)lists.size();
+	int i, j;
 
-	if (byte < 0x80) {
-		runningQ = 1;
-		if (runningCommand == 0) {
-			std::cerr << "Error: running command with no previous command" << std::endl;
-			return 0;
+	// Sequence numbers are used for sorting if all events have them.
+	int seqstate = -1;
+	bool mixedQ = false;
+	for (i=0; i<length; i++) {
+		if (lists[i]->size() == 0) {
+			continue;
 		}
-		if (runningCommand >= 0xf0) {
-			std::cerr << "Error: running status not permitted with meta and sysex"
-			     << " event." << std::endl;
-			std::cerr << "Byte is 0x" << std::hex << (int)byte << std::dec << std::endl;
-			return 0;
+		int state = lists[i]->getSequenceState();
+		if ((state < 0) || ((seqstate >= 0) && (state != seqstate))) {
+			mixedQ = true;
+		}
+		seqstate = state;
+	}
+
+	if (mixedQ) {
+		// Events cannot be ordered consistently, so concatenate the lists
+		// and sort them with eventcompare().
+		for (i=0; i<length; i++) {
+			for (j=0; j<(int)lists[i]->size(); j++) {
+				output.push_back_no_copy(&(*lists[i])[j]);
+			}
 		}
+		output.sort();
 	} else {
-		runningCommand = byte;
-		runningQ = 0;
-	}
-
-	array.push_back(runningCommand);
-	if (runningQ) {
-		array.push_back(byte);
-	}
-
-	switch (runningCommand & 0xf0) {
-		case 0x80:        // note off (2 more bytes)
-		case 0x90:        // note on (2 more bytes)
-		case 0xA0:        // aftertouch (2 more bytes)
-		case 0xB0:        // cont. controller (2 more bytes)
-		case 0xE0:        // pitch wheel (2 more bytes)
-			byte = readByte(input);
-			if (!status()) { return m_rwstatus; }
-			if (byte > 0x7f) {
-				std::cerr << "MIDI data byte too large: " << (int)byte << std::endl;
-				m_rwstatus = false; return m_rwstatus;
+		// Merge the lists (each sorted first if necessary) with a heap
+		// of the next event in each list.  Events with the same sorting
+		// keys are placed in list order, which gives the same result as
+		// sorting all events together.
+		std::vector<std::vector<MidiEventList::SortKey>> keys(length);
+		for (i=0; i<length; i++) {
+			if (!lists[i]->makeSortKeys(keys[i], seqstate)) {
+				std::sort(keys[i].begin(), keys[i].end());
 			}
-			array.push_back(byte);
-			if (!runningQ) {
-				byte = readByte(input);
-				if (!status()) { return m_rwstatus; }
-				if (byte > 0x7f) {
-					std::cerr << "MIDI data byte too large: " << (int)byte << std::endl;
-					m_rwstatus = false; return m_rwstatus;
-				}
-				array.push_back(byte);
+		}
+		// heap entries: the key of the next event of a list, and the
+		// list index (which orders events with the same keys).
+		struct Entry {
+			MidiEventList::SortKey key;
+			int track;
+		};
+		auto earlier = [](const Entry& a, const Entry& b) {
+			if (a.key.primary != b.key.primary) {
+				return a.key.primary < b.key.primary;
 			}
-			break;
-		case 0xC0:        // patch change (1 more byte)
-		case 0xD0:        // channel pressure (1 more byte)
-			if (!runningQ) {
-				byte = readByte(input);
-				if (!status()) { return m_rwstatus; }
-				if (byte > 0x7f) {
-					std::cerr << "MIDI data byte too large: " << (int)byte << std::endl;
-					m_rwstatus = false; return m_rwstatus;
-				}
-				array.push_back(byte);
+			if (a.key.secondary != b.key.secondary) {
+				return a.key.secondary < b.key.secondary;
 			}
-			break;
-		case 0xF0:
-			switch (runningCommand) {
-				case 0xff:                 // meta event
-					{
-					if (!runningQ) {
-						byte = readByte(input); // meta type
-						if (!status()) { return m_rwstatus; }
-						array.push_back(byte);
-					}
-					ulong length = 0;
-					uchar byte1 = 0;
-					uchar byte2 = 0;
-					uchar byte3 = 0;
-					uchar byte4 = 0;
-					byte1 = readByte(input);
-					if (!status()) { return m_rwstatus; }
-					array.push_back(byte1);
-					if (byte1 >= 0x80) {
-						byte2 = readByte(input);
-						if (!status()) { return m_rwstatus; }
-						array.push_back(byte2);
-						if (byte2 > 0x80) {
-							byte3 = readByte(input);
-							if (!status()) { return m_rwstatus; }
-							array.push_back(byte3);
-							if (byte3 >= 0x80) {
-								byte4 = readByte(input);
-								if (!status()) { return m_rwstatus; }
-								array.push_back(byte4);
-								if (byte4 >= 0x80) {
-									std::cerr << "Error: cannot handle large VLVs" << std::endl;
-									m_rwstatus = false; return m_rwstatus;
-								} else {
-									length = unpackVLV(byte1, byte2, byte3, byte4);
-									if (!m_rwstatus) { return m_rwstatus; }
-								}
-							} else {
-								length = unpackVLV(byte1, byte2, byte3);
-								if (!m_rwstatus) { return m_rwstatus; }
-							}
-						} else {
-							length = unpackVLV(byte1, byte2);
-							if (!m_rwstatus) { return m_rwstatus; }
-						}
-					} else {
-						length = byte1;
-					}
-					for (int j=0; j<(int)length; j++) {
-						byte = readByte(input); // meta type
-						if (!status()) { return m_rwstatus; }
-						array.push_back(byte);
-					}
-					}
+			return a.track < b.track;
+		};
+		auto later = [&](const Entry& a, const Entry& b) {
+			return earlier(b, a);
+		};
+		std::vector<Entry> heap;
+		heap.reserve(length);
+		for (i=0; i<length; i++) {
+			if (!keys[i].empty()) {
+				heap.push_back({keys[i][0], i});
+			}
+		}
+		std::make_heap(heap.begin(), heap.end(), later);
+		std::vector<int> position(length, 0);
+		while (!heap.empty()) {
+			int track = heap[0].track;
+			output.push_back_no_copy(&(*lists[track])[heap[0].key.index]);
+			if (++position[track] == (int)keys[track].size()) {
+				std::pop_heap(heap.begin(), heap.end(), later);
+				heap.pop_back();
+				continue;
+			}
+			// replace the top entry with the next event of its list,
+			// and move it down to its place in the heap.
+			Entry entry = {keys[track][position[track]], track};
+			int size = (int)heap.size();
+			int hole = 0;
+			while (true) {
+				int child = 2 * hole + 1;
+				if (child >= size) {
 					break;
-
-				// The 0xf0 and 0xf7 meta commands deal with system-exclusive
-				// messages. 0xf0 is used to either start a message or to store
-				// a complete message.  The 0xf0 is part of the outgoing MIDI
-				// bytes.  The 0xf7 message is used to send arbitrary bytes,
-				// typically the middle or ends of system exclusive messages.  The
-				// 0xf7 byte at the start of the message is not part of the
-				// outgoing raw MIDI bytes, but is kept in the MidiFile message
-				// to indicate a raw MIDI byte message (typically a partial
-				// system exclusive message).
-				case 0xf7:   // Raw bytes. 0xf7 is not part of the raw
-				             // bytes, but are included to indicate
-				             // that this is a raw byte message.
-				case 0xf0:   // System Exclusive message
-					{         // (complete, or start of message).
-					int length = (int)readVLValue(input);
-					for (int i=0; i<length; i++) {
-						byte = readByte(input);
-						if (!status()) { return m_rwstatus; }
-						array.push_back(byte);
-					}
-					}
+				}
+				if ((child + 1 < size) && earlier(heap[child + 1], heap[child])) {
+					child++;
+				}
+				if (!earlier(heap[child], entry)) {
 					break;
-
-				// other "F" MIDI commands are not expected, but can be
-				// handled here if they exist.
+				}
+				heap[hole] = heap[child];
+				hole = child;
 			}
-			break;
-		default:
-			std::cout << "Error reading midifile" << std::endl;
-			std::cout << "Command byte was " << (int)runningCommand << std::endl;
-			return 0;
+			heap[hole] = entry;
+		}
 	}
-	return 1;
+	for (i=0; i<length; i++) {
+		output.shareBlocks(*lists[i]);
+	}
+
 }
 
 
 
 //////////////////////////////
 //
-// MidiFile::readVLValue -- The VLV value is expected to be unpacked into
-//   a 4-byte integer no greater than 0x0fffFFFF, so a VLV value up to
-//   4-bytes in size (FF FF FF 7F) will only be considered.  Longer
-//   VLV values are not allowed in standard MIDI files, so the extract
-//   delta time would be truncated and the extra byte(s) will be parsed
-//   incorrectly as a MIDI command.
+// MidiFile::getTrackChunkSize -- Return the number of bytes needed to
+//    write a track as an MTrk chunk, including the chunk header and an
+//    end-of-track message.
 //
 
-ulong MidiFile::readVLValue(std::istream& input) {
-	uchar b[5] = {0};
-
-	for (int i=0; i<5; i++) {
-		b[i] = readByte(input);
-		if (!status()) { return m_rwstatus; }
-		if (b[i] < 0x80) {
-			break;
+size_t MidiFile::getTrackChunkSize(int track) const {
+	const MidiEventList& list = *m_events[track];
+	bool absoluteQ = (getTickState() == TIME_STATE_ABSOLUTE);
+	size_t output = 8 + 4;
+	int lasttick = 0;
+	int status = 0;
+	for (int j=0; j<list.size(); j++) {
+		const MidiEvent& event = list[j];
+		long delta = absoluteQ ? event.tick - lasttick : event.tick;
+		lasttick = event.tick;
+		if (event.empty() || event.isEndOfTrack()) {
+			continue;
+		}
+		output += Vlv::length(getVlvValue(delta)) + event.size();
+		if (m_runningStatus && isRunningStatus(event, status)) {
+			output--;
+		}
+		if ((event[0] == 0xf0) || (event[0] == 0xf7)) {
+			output += Vlv::length(getSysexLength(event));
 		}
 	}
-
-	return unpackVLV(b[0], b[1], b[2], b[3], b[4]);
+	return output;
 }
 
 
 
 //////////////////////////////
 //
-// MidiFile::unpackVLV -- converts a VLV value to an unsigned long value.
-//     The bytes a, b, c, d, e are in big-endian order (the order they would
-//     be read out of the MIDI file).
-// default values: a = b = c = d = 0;
+// MidiFile::writeTrackChunk -- Encode a track as an MTrk chunk.  The
+//    buffer must have room for getTrackChunkSize() bytes, which is the
+//    exact size of the chunk.  Returns the position after the chunk.
 //
 
-ulong MidiFile::unpackVLV(uchar a, uchar b, uchar c, uchar d, uchar e) {
-	uchar bytes[5] = {a, b, c, d, e};
-	int count = 0;
-	while ((count < 5) && (bytes[count] > 0x7f)) {
-		count++;
-	}
-	count++;
-	if (count >= 6) {
-		std::cerr << "VLV number is too large" << std::endl;
-		m_rwstatus = false;
-		return 0;
-	}
+uchar* MidiFile::writeTrackChunk(int track, uchar* ptr) const {
+	const MidiEventList& list = *m_events[track];
+	bool absoluteQ = (getTickState() == TIME_STATE_ABSOLUTE);
 
-	ulong output = 0;
-	for (int i=0; i<count; i++) {
-		output = output << 7;
-		output = output | (bytes[i] & 0x7f);
-	}
+	// first write the track ID marker "MTrk":
+	*ptr++ = 'M';
+	*ptr++ = 'T';
+	*ptr++ = 'r';
+	*ptr++ = 'k';
+	// leave space for the size of the MIDI data to follow:
+	uchar* sizeptr = ptr;
+	ptr += 4;
+	uchar* trackdata = ptr;
 
-	return output;
+	int lasttick = 0;
+	int status = 0;
+	for (int j=0; j<list.size(); j++) {
+		const MidiEvent& event = list[j];
+		long delta = absoluteQ ? event.tick - lasttick : event.tick;
+		if (absoluteQ && (j > 0) && (delta < 0)) {
+			std::cerr << "Error: negative delta tick value: " << delta << std::endl
+			     << "Timestamps must be sorted first"
+			     << " (use MidiFile::sortTracks() before writing)." << std::endl;
+		}
+		lasttick = event.tick;
+		if (event.empty()) {
+			// Don't write empty m_events (probably a delete message).
+			continue;
+		}
+		if (event.isEndOfTrack()) {
+			// Suppress end-of-track meta messages (one will be added
+			// automatically after all track data has been written).
+			continue;
+		}
+		if ((ulong)delta >= (1 << 28)) {
+			std::cerr << "Error: number too large to convert to VLV" << std::endl;
+		}
+		ptr += Vlv::encode(getVlvValue(delta), ptr);
+		// The bytes stored in the event, which do not include a payload
+		// view (accessing them through the MidiMessage functions would
+		// copy the payload into the event):
+		const std::vector<uchar>& bytes = event;
+		int size = (int)bytes.size();
+		if ((event[0] == 0xf0) || (event[0] == 0xf7)) {
+			// 0xf0 == Complete sysex message (0xf0 is part of the raw MIDI).
+			// 0xf7 == Raw byte message (0xf7 not part of the raw MIDI).
+			// Print the first byte of the message (0xf0 or 0xf7), then
+			// print a VLV length for the rest of the bytes in the message.
+			// In other words, when creating a 0xf0 or 0xf7 MIDI message,
+			// do not insert the VLV byte length yourself, as this code will
+			// do it for you automatically.
+			*ptr++ = event[0];
+			ptr += Vlv::encode(getSysexLength(event), ptr);
+			status = 0;
+			std::copy(bytes.data() + 1, bytes.data() + size, ptr);
+			ptr += size - 1;
+		} else if (m_runningStatus && isRunningStatus(event, status)) {
+			// same command byte as the previous channel message, so
+			// only output the data bytes:
+			std::copy(bytes.data() + 1, bytes.data() + size, ptr);
+			ptr += size - 1;
+		} else {
+			// non-sysex type of message, so just output the
+			// bytes of the message:
+			std::copy(bytes.data(), bytes.data() + size, ptr);
+			ptr += size;
+		}
+		if (event.hasPayloadView()) {
+			// payload stored in the input buffer of the file:
+			const uchar* payload = event.getPayload();
+			std::copy(payload, payload + event.getPayloadSize(), ptr);
+			ptr += event.getPayloadSize();
+		}
+	}
+	// End-of-track messages in the list have been suppressed, so the
+	// track always needs one.
+	*ptr++ = 0;
+	*ptr++ = 0xff;
+	*ptr++ = 0x2f;
+	*ptr++ = 0x00;
+	writeBigEndian(sizeptr, (ulong)(ptr - trackdata), 4);
+	return ptr;
 }
 
 
 
 //////////////////////////////
 //
-// MidiFile::writeVLValue -- write a number to the midifile
-//    as a variable length value which segments a file into 7-bit
-//    values and adds a contination bit to each.  Maximum size of input
-//    aValue is 0x0FFFffff.
+// MidiFile::isRunningStatus -- Returns true if the command byte of a
+//    channel message can be omitted when writing, since it is the same as
+//    the running status of the track.  The running status is updated for
+//    the message: channel messages set it, and meta and system-exclusive
+//    messages clear it.
 //
 
-void MidiFile::writeVLValue(long aValue, std::vector<uchar>& outdata) {
-	uchar bytes[4] = {0};
-
-	if ((unsigned long)aValue >= (1 << 28)) {
-		std::cerr << "Error: number too large to convert to VLV" << std::endl;
-		aValue = 0x0FFFffff;
+bool MidiFile::isRunningStatus(const MidiEvent& event, int& status) {
+	int command = event[0];
+	if (command < 0x80) {
+		// data bytes without a command byte
+		return false;
 	}
-
-	bytes[0] = (uchar)(((ulong)aValue >> 21) & 0x7f);  // most significant 7 bits
-	bytes[1] = (uchar)(((ulong)aValue >> 14) & 0x7f);
-	bytes[2] = (uchar)(((ulong)aValue >> 7)  & 0x7f);
-	bytes[3] = (uchar)(((ulong)aValue)       & 0x7f);  // least significant 7 bits
-
-	int start = 0;
-	while ((start<4) && (bytes[start] == 0))  start++;
-
-	for (int i=start; i<3; i++) {
-		bytes[i] = bytes[i] | 0x80;
-		outdata.push_back(bytes[i]);
+	if (command >= 0xf0) {
+		status = 0;
+		return false;
 	}
-	outdata.push_back(bytes[3]);
+	if (command == status) {
+		return true;
+	}
+	status = command;
+	return false;
 }
 
 
@@ -3036,41 +3757,32 @@ void MidiFile::clear_no_deallocate(void) {
 
 //////////////////////////////
 //
-// MidiFile::ticksearch -- for finding a tick entry in the time map.
-//
-
-int MidiFile::ticksearch(const void* A, const void* B) {
-	_TickTime& a = *((_TickTime*)A);
-	_TickTime& b = *((_TickTime*)B);
-
-	if (a.tick < b.tick) {
-		return -1;
-	} else if (a.tick > b.tick) {
-		return 1;
+// MidiFile::readAllBytes -- Read the rest of an input stream into a
+//     byte buffer.  Seekable streams are read with a single read() call.
+//
+
+bool MidiFile::readAllBytes(std::istream& input, std::vector<uchar>& buffer) {
+	buffer.clear();
+	std::streampos start = input.tellg();
+	if (start != std::streampos(-1)) {
+		input.seekg(0, std::ios::end);
+		std::streampos stop = input.tellg();
+		input.seekg(start, std::ios::beg);
+		if ((stop != std::streampos(-1)) && input.good()) {
+			buffer.resize((size_t)(stop - start));
+			input.read((char*)buffer.data(), buffer.size());
+			buffer.resize((size_t)input.gcount());
+			return !input.bad();
+		}
+		input.clear();
 	}
-	return 0;
+	buffer.assign(std::istreambuf_iterator<char>(input),
+			std::istreambuf_iterator<char>());
+	return !input.bad();
 }
 
 
 
-//////////////////////////////
-//
-// MidiFile::secondsearch -- for finding a second entry in the time map.
-//
-
-int MidiFile::secondsearch(const void* A, const void* B) {
-	_TickTime& a = *((_TickTime*)A);
-	_TickTime& b = *((_TickTime*)B);
-
-	if (a.seconds < b.seconds) {
-		return -1;
-	} else if (a.seconds > b.seconds) {
-		return 1;
-	}
-	return 0;
-}
-
-
 ///////////////////////////////////////////////////////////////////////////
 //
 // Static functions:
@@ -3360,27 +4072,15 @@ std::string MidiFile::getGMInstrumentName(int patchIndex) {
 
 //////////////////////////////
 //
-// MidiFile::base64Encode -- Encode a string as base64.
+// MidiFile::getBase64Size -- Return the number of characters in the
+//    base64 encoding of the given number of bytes, including the line
+//    breaks added by base64Encode() for a positive line width.
 //
 
-std::string MidiFile::base64Encode(const std::string& input) {
-	std::string output;
-	output.reserve(((input.size()/3) + (input.size() % 3 > 0)) * 4);
-	int vala = 0;
-	int valb = -6;
-	for (unsigned char c : input) {
-		vala = (vala << 8) + c;
-		valb += 8;
-		while (valb >=0) {
-			output.push_back(MidiFile::encodeLookup[(vala >> valb) & 0x3F]);
-			valb -= 6;
-		}
-	}
-	if (valb > -6) {
-		output.push_back(MidiFile::encodeLookup[((vala << 8) >> (valb + 8)) & 0x3F]);
-	}
-	while (output.size() % 4) {
-		output.push_back(MidiFile::encodeLookup.back());
+size_t MidiFile::getBase64Size(size_t size, int width) {
+	size_t output = (size + 2) / 3 * 4;
+	if (width > 0) {
+		output += output / width + (((output + 1) % width) ? 1 : 0);
 	}
 	return output;
 }
@@ -3389,31 +4089,208 @@ std::string MidiFile::base64Encode(const std::string& input) {
 
 //////////////////////////////
 //
-// MidiFile::base64Decode -- Decode a base64 string.
-//
+// MidiFile::base64Encode -- Encode bytes as base64 into an output buffer
+//    which has room for getBase64Size() characters.  Each group of three
+//    bytes is split into two 12-bit values which are looked up as pairs of
+//    characters, and groups are encoded four at a time (12 bytes to 16
+//    characters).  With a positive width, a line break is added after
+//    every width characters, and a final line break is added unless the
+//    last line is one character short of the width.  Returns the number of
+//    characters written.
+//
+
+size_t MidiFile::base64Encode(const uchar* input, size_t size, char* output,
+		int width) {
+	static const std::vector<char> pairs = []() {
+		std::vector<char> table(4096 * 2);
+		for (int i=0; i<4096; i++) {
+			table[2*i]   = MidiFile::encodeLookup[i >> 6];
+			table[2*i+1] = MidiFile::encodeLookup[i & 0x3f];
+		}
+		return table;
+	}();
+
+	// Encode count groups of three bytes into 4*count characters.
+	auto encodeGroups = [&](const uchar* in, size_t count, char* out) {
+		const char* table = pairs.data();
+		for (; count >= 4; count -= 4) {
+			for (int k=0; k<4; k++) {
+				uint32_t value = ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+				std::memcpy(out,     table + 2 * (value >> 12),    2);
+				std::memcpy(out + 2, table + 2 * (value & 0xfff), 2);
+				in  += 3;
+				out += 4;
+			}
+		}
+		for (; count > 0; count--) {
+			uint32_t value = ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+			std::memcpy(out,     table + 2 * (value >> 12),    2);
+			std::memcpy(out + 2, table + 2 * (value & 0xfff), 2);
+			in  += 3;
+			out += 4;
+		}
+	};
+
+	size_t groups = size / 3;
+	int remainder = (int)(size % 3);
+	char last[4];
+	if (remainder) {
+		// pad the last group with zero bytes and '=' characters
+		uchar bytes[3] = {input[3*groups], 0, 0};
+		if (remainder == 2) {
+			bytes[1] = input[3*groups+1];
+		}
+		encodeGroups(bytes, 1, last);
+		last[3] = '=';
+		if (remainder == 1) {
+			last[2] = '=';
+		}
+	}
+
+	char* ptr = output;
+	if (width <= 0) {
+		encodeGroups(input, groups, ptr);
+		ptr += 4 * groups;
+		if (remainder) {
+			std::memcpy(ptr, last, 4);
+			ptr += 4;
+		}
+		return ptr - output;
+	}
+
+	// Line width mode: runs of whole groups which fit on the current line
+	// are encoded directly, and only groups which cross a line break are
+	// encoded into a temporary buffer.
+	int column = 0;
+	auto putChars = [&](const char* chars, int count) {
+		for (int k=0; k<count; k++) {
+			*ptr++ = chars[k];
+			if (++column == width) {
+				*ptr++ = '\n';
+				column = 0;
+			}
+		}
+	};
+	size_t group = 0;
+	while (group < groups) {
+		size_t fit = (width - column) / 4;
+		if (fit == 0) {
+			char chars[4];
+			encodeGroups(input + 3 * group, 1, chars);
+			putChars(chars, 4);
+			group++;
+			continue;
+		}
+		fit = std::min(fit, groups - group);
+		encodeGroups(input + 3 * group, fit, ptr);
+		ptr += 4 * fit;
+		column += 4 * (int)fit;
+		group += fit;
+		if (column == width) {
+			*ptr++ = '\n';
+			column = 0;
+		}
+	}
+	if (remainder) {
+		putChars(last, 4);
+	}
+	size_t length = (size + 2) / 3 * 4;
+	if ((length + 1) % width != 0) {
+		*ptr++ = '\n';
+	}
+	return ptr - output;
+}
 
-std::string MidiFile::base64Decode(const std::string& input) {
-	// vector<int> decodeLookup(256,-1);
-	// for (int i=0; i<64; i++) decodeLookup[encodeLookup[i]] = i;
 
-	std::string output;
+
+//////////////////////////////
+//
+// MidiFile::base64Decode -- Decode base64 characters into a byte buffer
+//    (the buffer is cleared first, but keeps its allocated memory).
+//    Characters which are not part of the base64 alphabet, such as line
+//    breaks, are skipped, and decoding stops at the first '='.  Blocks of
+//    16 characters without any such characters are decoded to 12 bytes at
+//    a time with tables which give the bits of each character already
+//    shifted into place for its position in a group of four.
+//
+
+void MidiFile::base64Decode(const char* input, size_t size,
+		std::vector<uchar>& output) {
+	// Bit 24 marks characters which are not in the base64 alphabet.
+	static const std::vector<uint32_t> tables = []() {
+		std::vector<uint32_t> table(4 * 256);
+		for (int i=0; i<256; i++) {
+			int value = MidiFile::decodeLookup[i];
+			for (int k=0; k<4; k++) {
+				table[k * 256 + i] = value < 0 ? 0x1000000u :
+						(uint32_t)value << (6 * (3 - k));
+			}
+		}
+		return table;
+	}();
+	const uint32_t* table = tables.data();
+
+	// Decode the group of four characters at in, returning the 24 bits of
+	// the group, with bit 24 set if the group cannot be decoded directly.
+	auto decodeGroup = [&](const uchar* in) {
+		return table[in[0]] | table[256 + in[1]] | table[512 + in[2]] |
+				table[768 + in[3]];
+	};
+
+	output.resize(size / 4 * 3 + 3);
+	const uchar* in = (const uchar*)input;
+	const uchar* end = in + size;
+	uchar* out = output.data();
 	int vala = 0;
 	int valb = -8;
-	for (unsigned char c : input) {
+	while (in < end) {
+		if (valb == -8) {
+			// at the start of a group of four characters
+			while (end - in >= 16) {
+				uint32_t a = decodeGroup(in);
+				uint32_t b = decodeGroup(in + 4);
+				uint32_t c = decodeGroup(in + 8);
+				uint32_t d = decodeGroup(in + 12);
+				if ((a | b | c | d) & 0x1000000u) {
+					break;
+				}
+				uint32_t values[4] = {a, b, c, d};
+				for (int k=0; k<4; k++) {
+					*out++ = (uchar)(values[k] >> 16);
+					*out++ = (uchar)(values[k] >> 8);
+					*out++ = (uchar)values[k];
+				}
+				in += 16;
+			}
+			while (end - in >= 4) {
+				uint32_t value = decodeGroup(in);
+				if (value & 0x1000000u) {
+					break;
+				}
+				*out++ = (uchar)(value >> 16);
+				*out++ = (uchar)(value >> 8);
+				*out++ = (uchar)value;
+				in += 4;
+			}
+			if (in >= end) {
+				break;
+			}
+		}
+		uchar c = *in++;
 		if (c == '=') {
 			break;
 		} else if (MidiFile::decodeLookup[c] == -1) {
-         // Ignore whitespace, for example.
+			// Ignore whitespace, for example.
 			continue;
 		}
-		vala = (vala << 6) + MidiFile::decodeLookup[c];
+		vala = ((vala << 6) + MidiFile::decodeLookup[c]) & 0xfffff;
 		valb += 6;
 		if (valb >= 0) {
-			output.push_back(char((vala >> valb) & 0xFF));
+			*out++ = (uchar)((vala >> valb) & 0xFF);
 			valb -= 8;
 		}
 	}
-	return output;
+	output.resize(out - output.data());
 }
 
 
@@ -0,0 +1,371 @@
+//
+// Creation Date: Mon Oct 19 14:03:11 PDT 2026
+// Filename:      midifile/src/MidiFileSet.cpp
+// Website:       http://midifile.sapp.org
+// Syntax:        C++17
+// vim:           ts=3 noexpandtab
+//
+// Description:   A class which loads many Standard MIDI Files into shared
+//                arrays of event ticks and message bytes, so that a large
+//                collection of files does not need one MidiFile object
+//                (and one allocation per event) for each file.  Files in
+//                the set are accessed through lightweight view objects.
+//
+
+#include "MidiFileSet.h"
+#include "MidiFile.h"
+#include "SmfReader.h"
+
+#include <fstream>
+#include <iostream>
+
+
+namespace smf {
+
+//////////////////////////////
+//
+// MidiFileSet::MidiFileSet -- Constructor.
+//
+
+MidiFileSet::MidiFileSet(void) {
+	clear();
+}
+
+
+
+//////////////////////////////
+//
+// MidiFileSet::~MidiFileSet -- Deconstructor.
+//
+
+MidiFileSet::~MidiFileSet() {
+	// do nothing
+}
+
+
+
+//////////////////////////////
+//
+// MidiFileSet::addFile -- Read a Standard MIDI File and add it to the
+//     set.  Returns the index of the file in the set, or -1 if the file
+//     could not be read (in which case the set is not changed).
+//
+
+int MidiFileSet::addFile(const std::string& filename) {
+	std::ifstream input(filename.c_str(), std::ios::binary | std::ios::in);
+	if (!input.is_open()) {
+		std::cerr << "Error: cannot open file " << filename << std::endl;
+		return -1;
+	}
+	std::vector<uchar> buffer;
+	if (!MidiFile::readAllBytes(input, buffer)) {
+		std::cerr << "Error: cannot read file " << filename << std::endl;
+		return -1;
+	}
+	return addData(buffer.data(), buffer.size(), filename);
+}
+
+
+
+//////////////////////////////
+//
+// MidiFileSet::addFiles -- Read a list of Standard MIDI Files.  Files
+//     which cannot be read are skipped (use MidiFileView::getFilename() to
+//     match files to the input list).  Returns the number of files added.
+//
+
+int MidiFileSet::addFiles(const std::vector<std::string>& filenames) {
+	int count = 0;
+	m_tpq.reserve(m_tpq.size() + filenames.size());
+	m_names.reserve(m_names.size() + filenames.size());
+	for (int i=0; i<(int)filenames.size(); i++) {
+		if (addFile(filenames[i]) >= 0) {
+			count++;
+		}
+	}
+	return count;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFileSet::addData -- Parse Standard MIDI File bytes and add them to
+//     the set.  The data is copied, so it does not need to stay allocated.
+//     Returns the index of the file in the set, or -1 if the data is not
+//     a valid type-0 or type-1 MIDI file.
+//
+
+int MidiFileSet::addData(const uchar* data, size_t size,
+		const std::string& name) {
+	const uchar* ptr = data;
+	const uchar* end = data + size;
+
+	SmfHeader header;
+	int status = SmfReader::readHeader(ptr, end, header);
+	if (status != SmfReader::SMF_OK) {
+		std::cerr << "Error: " << name << ": "
+		     << SmfReader::getErrorMessage(status) << std::endl;
+		return -1;
+	}
+
+	size_t oldevents = m_ticks.size();
+	size_t oldbytes = m_bytes.size();
+	size_t oldtracks = m_trackstart.size();
+
+	for (int i=0; i<header.tracks; i++) {
+		ulong chunksize;
+		status = SmfReader::readTrackStart(ptr, end, chunksize);
+		if (status == SmfReader::SMF_OK) {
+			status = SmfReader::readTrack(ptr, end, [this](const SmfMessage& message) {
+				m_ticks.push_back(message.tick);
+				m_bytes.push_back(message.command);
+				if (message.isMeta()) {
+					// meta messages keep their type and length
+					m_bytes.push_back(message.metatype);
+					m_bytes.insert(m_bytes.end(), message.length, message.data);
+				}
+				m_bytes.insert(m_bytes.end(), message.data,
+						message.data + message.size);
+				m_offsets.push_back(m_bytes.size());
+				return true;
+			});
+		}
+		if (status != SmfReader::SMF_OK) {
+			std::cerr << "Error: " << name << ": "
+			     << SmfReader::getErrorMessage(status) << " in track " << i
+			     << std::endl;
+			break;
+		}
+		m_trackstart.push_back((int)m_ticks.size());
+	}
+
+	if ((int)(m_trackstart.size() - oldtracks) != header.tracks) {
+		// remove the partially read file.
+		m_ticks.resize(oldevents);
+		m_offsets.resize(oldevents + 1);
+		m_bytes.resize(oldbytes);
+		m_trackstart.resize(oldtracks);
+		return -1;
+	}
+
+	m_filestart.push_back((int)m_trackstart.size() - 1);
+	m_tpq.push_back(header.getTicksPerQuarterNote());
+	m_names.push_back(name);
+	return (int)m_tpq.size() - 1;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFileSet::reserve -- Pre-allocate storage for the given number of
+//     files, events and message bytes.
+//
+
+void MidiFileSet::reserve(int files, size_t events, size_t bytes) {
+	m_tpq.reserve(files);
+	m_names.reserve(files);
+	m_filestart.reserve(files + 1);
+	m_ticks.reserve(events);
+	m_offsets.reserve(events + 1);
+	m_bytes.reserve(bytes);
+}
+
+
+
+//////////////////////////////
+//
+// MidiFileSet::clear -- Remove all files and release their memory.
+//
+
+void MidiFileSet::clear(void) {
+	std::vector<int>().swap(m_ticks);
+	std::vector<size_t>().swap(m_offsets);
+	std::vector<uchar>().swap(m_bytes);
+	std::vector<int>().swap(m_trackstart);
+	std::vector<int>().swap(m_filestart);
+	std::vector<int>().swap(m_tpq);
+	std::vector<std::string>().swap(m_names);
+	m_offsets.push_back(0);
+	m_trackstart.push_back(0);
+	m_filestart.push_back(0);
+}
+
+
+
+//////////////////////////////
+//
+// MidiFileSet::size -- Return the number of files in the set.
+//
+
+int MidiFileSet::size(void) const {
+	return (int)m_tpq.size();
+}
+
+
+
+//////////////////////////////
+//
+// MidiFileSet::getEventCount -- Return the number of events in all files.
+//
+
+size_t MidiFileSet::getEventCount(void) const {
+	return m_ticks.size();
+}
+
+
+
+//////////////////////////////
+//
+// MidiFileSet::operator[] -- Return a view of a file in the set.  Views
+//     stay valid while the file is in the set, but the event data which
+//     they return become invalid when more files are added.
+//
+
+MidiFileView MidiFileSet::operator[](int index) const {
+	return MidiFileView(this, index);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////
+//
+// MidiFileView --
+//
+
+MidiFileView::MidiFileView(const MidiFileSet* set, int file) {
+	m_set = set;
+	m_file = file;
+}
+
+
+int MidiFileView::getTrackCount(void) const {
+	return m_set->m_filestart[m_file + 1] - m_set->m_filestart[m_file];
+}
+
+
+int MidiFileView::getTicksPerQuarterNote(void) const {
+	return m_set->m_tpq[m_file];
+}
+
+
+int MidiFileView::getEventCount(void) const {
+	return m_set->m_trackstart[m_set->m_filestart[m_file + 1]] -
+	       m_set->m_trackstart[m_set->m_filestart[m_file]];
+}
+
+
+const std::string& MidiFileView::getFilename(void) const {
+	return m_set->m_names[m_file];
+}
+
+
+MidiTrackView MidiFileView::operator[](int track) const {
+	return MidiTrackView(m_set, m_set->m_filestart[m_file] + track);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////
+//
+// MidiTrackView --
+//
+
+MidiTrackView::MidiTrackView(const MidiFileSet* set, int track) {
+	m_set = set;
+	m_track = track;
+}
+
+
+int MidiTrackView::size(void) const {
+	return m_set->m_trackstart[m_track + 1] - m_set->m_trackstart[m_track];
+}
+
+
+MidiEventView MidiTrackView::operator[](int index) const {
+	int i = m_set->m_trackstart[m_track] + index;
+	MidiEventView output;
+	output.tick = m_set->m_ticks[i];
+	output.data = m_set->m_bytes.data() + m_set->m_offsets[i];
+	output.size = (int)(m_set->m_offsets[i + 1] - m_set->m_offsets[i]);
+	return output;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////
+//
+// MidiEventView --
+//
+
+int MidiEventView::getCommandByte(void) const {
+	return size > 0 ? data[0] : -1;
+}
+
+
+int MidiEventView::getCommandNibble(void) const {
+	return size > 0 ? (data[0] & 0xf0) : -1;
+}
+
+
+int MidiEventView::getChannelNibble(void) const {
+	return size > 0 ? (data[0] & 0x0f) : -1;
+}
+
+
+int MidiEventView::getP1(void) const {
+	return size > 1 ? data[1] : -1;
+}
+
+
+int MidiEventView::getP2(void) const {
+	return size > 2 ? data[2] : -1;
+}
+
+
+bool MidiEventView::isNoteOn(void) const {
+	return (size == 3) && ((data[0] & 0xf0) == 0x90) && (data[2] > 0);
+}
+
+
+bool MidiEventView::isNoteOff(void) const {
+	return (size == 3) && (((data[0] & 0xf0) == 0x80) ||
+			(((data[0] & 0xf0) == 0x90) && (data[2] == 0)));
+}
+
+
+bool MidiEventView::isMeta(void) const {
+	return (size >= 3) && (data[0] == 0xff);
+}
+
+
+int MidiEventView::getMetaType(void) const {
+	return isMeta() ? data[1] : -1;
+}
+
+
+bool MidiEventView::isTempo(void) const {
+	return (size == 6) && (data[0] == 0xff) && (data[1] == 0x51);
+}
+
+
+int MidiEventView::getTempoMicroseconds(void) const {
+	if (!isTempo()) {
+		return -1;
+	}
+	return (data[3] << 16) | (data[4] << 8) | data[5];
+}
+
+
+MidiMessage MidiEventView::getMessage(void) const {
+	MidiMessage output;
+	output.assign(data, data + size);
+	return output;
+}
+
+
+} // end namespace smf
+
+
+
@@ -4,7 +4,7 @@
 // Last Modified: Sun Apr 15 11:11:05 PDT 2018 Added event removal system.
 // Filename:      midifile/src/MidiMessage.cpp
 // Website:       http://midifile.sapp.org
-// Syntax:        C++11
+// Syntax:        C++17
 // vim:           ts=3 noexpandtab
 //
 // Description:   Storage for bytes of a MIDI message for Standard
@@ -12,6 +12,7 @@
 //
 
 #include "MidiMessage.h"
+#include "Vlv.h"
 
 #include <cmath>
 #include <iostream>
@@ -79,7 +80,7 @@ MidiMessage::MidiMessage(const std::vector<int>& message) : vector<uchar>() {
 //
 
 MidiMessage::~MidiMessage() {
-	resize(0);
+	clear();
 }
 
 
@@ -93,7 +94,16 @@ MidiMessage& MidiMessage::operator=(const MidiMessage& message) {
 	if (this == &message) {
 		return *this;
 	}
-	std::vector<uchar>::operator=(static_cast<const std::vector<uchar> &>(message));
+	// Copies store their own payload, since they may outlive the MidiFile
+	// which owns a payload view.
+	clearPayloadView();
+	const std::vector<uchar>& header = message;
+	std::vector<uchar>::reserve(message.size());
+	std::vector<uchar>::assign(header.begin(), header.end());
+	if (message.hasPayloadView()) {
+		std::vector<uchar>::insert(std::vector<uchar>::end(), message.m_payload,
+				message.m_payload + message.m_payloadsize);
+	}
 	return *this;
 }
 
@@ -120,6 +130,113 @@ MidiMessage& MidiMessage::operator=(const std::vector<int>& bytes) {
 
 
 
+//////////////////////////////
+//
+// MidiMessage::getPayload -- Return a pointer to the data bytes of a meta
+//     message (after the length VLV) or a system-exclusive message (after
+//     the 0xf0/0xf7 command byte).  If the payload is a view into the input
+//     buffer of a MidiFile, then it is only valid while the MidiFile still
+//     contains the data read from that file.  Returns NULL for other
+//     messages or if there is no payload.
+//
+
+const uchar* MidiMessage::getPayload(void) const {
+	if (m_payload != NULL) {
+		return m_payload;
+	}
+	int start = getPayloadStart();
+	if ((start <= 0) || (start >= (int)this->size())) {
+		return NULL;
+	}
+	return std::vector<uchar>::data() + start;
+}
+
+
+
+//////////////////////////////
+//
+// MidiMessage::getPayloadSize -- Return the number of data bytes in a meta
+//     or system-exclusive message.
+//
+
+int MidiMessage::getPayloadSize(void) const {
+	if (m_payload != NULL) {
+		return m_payloadsize;
+	}
+	int start = getPayloadStart();
+	if ((start <= 0) || (start >= (int)this->size())) {
+		return 0;
+	}
+	return (int)this->size() - start;
+}
+
+
+
+//////////////////////////////
+//
+// MidiMessage::setPayloadView -- Use external bytes as the payload of a
+//     meta or system-exclusive message.  The message bytes must already
+//     contain the header of the message (0xff, type and length VLV for meta
+//     messages or 0xf0/0xf7 for system exclusives), but not the payload
+//     itself.  The data must stay allocated as long as the message uses
+//     them.  The payload is copied into the message as soon as the message
+//     is modified (or accessed through data() or iterators), so that the
+//     view is never written to.
+//
+
+void MidiMessage::setPayloadView(const uchar* data, int size) {
+	if ((data == NULL) || (size <= 0)) {
+		clearPayloadView();
+		return;
+	}
+	m_payload     = data;
+	m_payloadsize = size;
+}
+
+
+
+//////////////////////////////
+//
+// MidiMessage::getFullMessage -- Return a copy of the complete message,
+//     including a payload which is stored as a view (as does the copy
+//     constructor).
+//
+
+MidiMessage MidiMessage::getFullMessage(void) const {
+	return MidiMessage(*this);
+}
+
+
+
+//////////////////////////////
+//
+// MidiMessage::getPayloadStart -- Return the index of the first payload
+//     byte in a meta or system-exclusive message, or -1 for other messages.
+//
+
+int MidiMessage::getPayloadStart(void) const {
+	// the header is always stored in the message bytes:
+	const std::vector<uchar>& header = *this;
+	if (header.empty()) {
+		return -1;
+	}
+	uchar command = header[0];
+	if ((command == 0xf0) || (command == 0xf7)) {
+		return 1;
+	}
+	if ((command != 0xff) || (header.size() < 3)) {
+		return -1;
+	}
+	ulong length = 0;
+	int count = Vlv::decode(header.data() + 2, header.size() - 2, length);
+	if (count == 0) {
+		return -1;
+	}
+	return 2 + count;
+}
+
+
+
 //////////////////////////////
 //
 // MidiMessage::setSize -- Change the size of the message byte list.
@@ -1205,6 +1322,7 @@ void MidiMessage::setParameters(int p1, int p2) {
 //
 
 void MidiMessage::setMessage(const std::vector<uchar>& message) {
+	clearPayloadView();
 	this->resize(message.size());
 	for (int i=0; i<(int)this->size(); i++) {
 		(*this)[i] = message[i];
@@ -1213,6 +1331,7 @@ void MidiMessage::setMessage(const std::vector<uchar>& message) {
 
 
 void MidiMessage::setMessage(const std::vector<char>& message) {
+	clearPayloadView();
 	resize(message.size());
 	for (int i=0; i<(int)size(); i++) {
 		(*this)[i] = (uchar)message[i];
@@ -1221,6 +1340,7 @@ void MidiMessage::setMessage(const std::vector<char>& message) {
 
 
 void MidiMessage::setMessage(const std::vector<int>& message) {
+	clearPayloadView();
 	resize(message.size());
 	for (int i=0; i<(int)size(); i++) {
 		(*this)[i] = (uchar)message[i];
@@ -1502,24 +1622,12 @@ std::string MidiMessage::getMetaContent(void) {
 	if (!isMetaMessage()) {
 		return output;
 	}
-	int start = 3;
-	if (operator[](2) > 0x7f) {
-		start++;
-		if (operator[](3) > 0x7f) {
-			start++;
-			if (operator[](4) > 0x7f) {
-				start++;
-				if (operator[](5) > 0x7f) {
-					start++;
-					// maximum of 5 bytes in VLV, so last must be < 0x80
-				}
-			}
-		}
-	}
-	output.reserve(this->size());
-	for (int i=start; i<(int)this->size(); i++) {
-		output.push_back(operator[](i));
+	// getPayload() also handles ill-formed lengths (by returning NULL).
+	const uchar* payload = getPayload();
+	if (payload == NULL) {
+		return output;
 	}
+	output.assign((const char*)payload, getPayloadSize());
 	return output;
 }
 
@@ -1539,10 +1647,13 @@ void MidiMessage::setMetaContent(const std::string& content) {
 		// invalid message, so ignore request
 		return;
 	}
-	if (operator[](0) != 0xFF) {
+	const MidiMessage& message = *this;
+	if (message[0] != 0xFF) {
 		// not a meta message, so ignore request
 		return;
 	}
+	// the old content (which may be a payload view) is replaced:
+	clearPayloadView();
 	this->resize(2);
 
 	// add the size of the meta message data (VLV)
@@ -1915,38 +2026,9 @@ void MidiMessage::makeCue(const std::string& text) {
 //
 
 std::vector<uchar> MidiMessage::intToVlv(int value) {
-	std::vector<uchar> output;
-	if (value < 128) {
-		output.push_back((uchar)value);
-	} else {
-		// calculate VLV bytes and insert into message
-		uchar byte1 = value & 0x7f;
-		uchar byte2 = (value >>  7) & 0x7f;
-		uchar byte3 = (value >> 14) & 0x7f;
-		uchar byte4 = (value >> 21) & 0x7f;
-		uchar byte5 = (value >> 28) & 0x7f;
-		if (byte5) {
-			byte4 |= 0x80;
-		}
-		if (byte4) {
-			byte4 |= 0x80;
-			byte3 |= 0x80;
-		}
-		if (byte3) {
-			byte3 |= 0x80;
-			byte2 |= 0x80;
-		}
-		if (byte2) {
-			byte2 |= 0x80;
-		}
-		if (byte5) { output.push_back(byte5); }
-		if (byte4) { output.push_back(byte4); }
-		if (byte3) { output.push_back(byte3); }
-		if (byte2) { output.push_back(byte2); }
-		output.push_back(byte1);
-	}
-
-	return output;
+	uchar bytes[5];
+	int count = Vlv::encode((ulong)(unsigned int)value, bytes);
+	return std::vector<uchar>(bytes, bytes + count);
 }
 
 
@@ -2281,7 +2363,9 @@ void MidiMessage::makeTemperamentMeantoneCommaHalf(int referencePitchClass, int
 //    and system exclusives which could be dealt with later).
 //
 
-std::ostream& operator<<(std::ostream& out, MidiMessage& message) {
+std::ostream& operator<<(std::ostream& out, MidiMessage& event) {
+	// const access, so that a payload view is not copied into the message:
+	const MidiMessage& message = event;
 	for (int i=0; i<(int)message.size(); i++) {
 		if (message[i] >= 0x80) {
 			out << "0x" << std::hex << std::setw(2) << std::setfill('0') << (int)message[i];
@@ -0,0 +1,49 @@
+//
+// Creation Date: Mon Oct 19 18:05:12 PDT 2026
+// Filename:      midifile/tests/TestCheck.h
+// Website:       http://midifile.sapp.org
+// Syntax:        C++17
+// vim:           ts=3 noexpandtab
+//
+// Description:   Checks for the test programs.  CHECK() prints each
+//                condition which fails, and main() returns testResult()
+//                so that ctest reports the failure.
+//
+
+#ifndef _TESTCHECK_H_INCLUDED
+#define _TESTCHECK_H_INCLUDED
+
+#include <iostream>
+
+static int testFailures = 0;
+
+#define CHECK(condition)                                              \
+	do {                                                               \
+		if (!(condition)) {                                             \
+			std::cerr << __FILE__ << ":" << __LINE__                     \
+			          << ": check failed: " << #condition << std::endl;  \
+			testFailures++;                                              \
+		}                                                               \
+	} while (0)
+
+
+
+//////////////////////////////
+//
+// testResult -- Print the number of failed checks, and return the exit
+//     code of the test program.
+//
+
+static inline int testResult(void) {
+	if (testFailures) {
+		std::cerr << testFailures << " check(s) failed" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+
+#endif /* _TESTCHECK_H_INCLUDED */
+
+
+
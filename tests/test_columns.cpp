@@ -0,0 +1,202 @@
+//
+// Creation Date: Mon Oct 19 18:58:03 PDT 2026
+// Filename:      midifile/tests/test_columns.cpp
+// Website:       http://midifile.sapp.org
+// Syntax:        C++17
+// vim:           ts=3 noexpandtab
+//
+// Description:   Tests of the MidiEventColumns scans: each instruction set
+//                which the processor supports must give the same results
+//                as the scalar code and as a direct pass over the MidiFile,
+//                for row counts which do and do not fill the vector width.
+//
+
+#include "MidiEventColumns.h"
+#include "TestCheck.h"
+
+#include <random>
+#include <vector>
+
+using namespace smf;
+
+
+//////////////////////////////
+//
+// makeRandomFile -- A file with the given number of events in each of
+//     its tracks: note-ons (some with velocity 0), note-offs, controllers,
+//     meta messages, short messages, and note-ons with an invalid key
+//     byte.  Ticks are not sorted and can be negative.
+//
+
+static void makeRandomFile(MidiFile& midifile, const std::vector<int>& sizes,
+		std::mt19937& generator) {
+	midifile.clear();
+	if (sizes.size() > 1) {
+		midifile.addTracks((int)sizes.size() - 1);
+	}
+	std::vector<uchar> bytes;
+	for (int track=0; track<(int)sizes.size(); track++) {
+		for (int i=0; i<sizes[track]; i++) {
+			int tick = (int)(generator() % 2000) - 100;
+			int channel = generator() % 16;
+			int key = generator() % 128;
+			switch (generator() % 8) {
+				case 0:
+				case 1:
+				case 2:
+					midifile.addNoteOn(track, tick, channel, key, generator() % 128);
+					break;
+				case 3:
+					midifile.addNoteOff(track, tick, channel, key, 64);
+					break;
+				case 4:
+					midifile.addController(track, tick, channel, key, 1);
+					break;
+				case 5:
+					midifile.addText(track, tick, "text");
+					break;
+				case 6:
+					bytes = {(uchar)(0xc0 | channel), (uchar)key};
+					midifile.addEvent(track, tick, bytes);
+					break;
+				case 7:
+					bytes = {(uchar)(0x90 | channel), (uchar)(0x80 | key), 0x40};
+					midifile.addEvent(track, tick, bytes);
+					break;
+			}
+		}
+	}
+}
+
+
+
+//////////////////////////////
+//
+// Results -- The output of each scan.
+//
+
+struct Results {
+	std::vector<int> counts;
+	std::vector<int> histogram;
+	std::vector<int> rows;
+	std::vector<int> onsets;
+	std::vector<int> range;
+	std::vector<int> emptyrange;
+
+	bool operator==(const Results& other) const {
+		return (counts == other.counts) && (histogram == other.histogram) &&
+		       (rows == other.rows) && (onsets == other.onsets) &&
+		       (range == other.range) && (emptyrange == other.emptyrange);
+	}
+};
+
+
+
+//////////////////////////////
+//
+// getScanResults -- Run the scans of the columns.
+//
+
+static Results getScanResults(const MidiEventColumns& columns) {
+	Results output;
+	columns.getNoteOnCounts(output.counts);
+	columns.getPitchHistogram(output.histogram);
+	columns.getNoteOnRows(output.rows);
+	columns.getOnsetTicks(output.onsets);
+	columns.getRowsInTickRange(0, 1000, output.range);
+	columns.getRowsInTickRange(500, 500, output.emptyrange);
+	return output;
+}
+
+
+
+//////////////////////////////
+//
+// getExpectedResults -- Calculate the scan results directly from the
+//     events of the MidiFile.
+//
+
+static Results getExpectedResults(const MidiFile& midifile) {
+	Results output;
+	output.counts.assign(16, 0);
+	output.histogram.assign(128, 0);
+	int row = 0;
+	for (int track=0; track<midifile.getTrackCount(); track++) {
+		for (int i=0; i<midifile[track].size(); i++) {
+			const MidiEvent& event = midifile[track][i];
+			if (event.isNoteOn()) {
+				output.counts[event.getChannelNibble()]++;
+				if (event[1] < 128) {
+					output.histogram[event[1]]++;
+				}
+				output.rows.push_back(row);
+				output.onsets.push_back(event.tick);
+			}
+			if ((event.tick >= 0) && (event.tick < 1000)) {
+				output.range.push_back(row);
+			}
+			row++;
+		}
+	}
+	return output;
+}
+
+
+
+//////////////////////////////
+//
+// testScans -- Compare the scans at each supported instruction set level
+//     with the expected results.
+//
+
+static void testScans(void) {
+	int oldlevel = MidiEventColumns::getSimdLevel();
+	MidiEventColumns::setSimdLevel(2);
+	int supported = MidiEventColumns::getSimdLevel();
+
+	std::mt19937 generator(45);
+	std::vector<std::vector<int>> filesizes;
+	for (int size=0; size<=70; size++) {
+		filesizes.push_back({size});
+	}
+	filesizes.push_back({1000});
+	filesizes.push_back({0, 33, 1, 0, 64, 15});
+	filesizes.push_back({513, 257, 129});
+
+	MidiFile midifile;
+	MidiEventColumns columns;
+	for (auto& sizes : filesizes) {
+		makeRandomFile(midifile, sizes, generator);
+		columns.build(midifile);
+		Results expected = getExpectedResults(midifile);
+		Results scalar;
+		for (int level=0; level<=supported; level++) {
+			MidiEventColumns::setSimdLevel(level);
+			CHECK(MidiEventColumns::getSimdLevel() == level);
+			Results results = getScanResults(columns);
+			CHECK(results == expected);
+			if (level == 0) {
+				scalar = results;
+			} else {
+				CHECK(results == scalar);
+			}
+		}
+	}
+
+	MidiEventColumns::setSimdLevel(oldlevel);
+}
+
+
+
+//////////////////////////////
+//
+// main --
+//
+
+int main(void) {
+	testScans();
+	return testResult();
+}
+
+
+
@@ -0,0 +1,262 @@
+//
+// Creation Date: Mon Oct 19 18:31:48 PDT 2026
+// Filename:      midifile/tests/test_roundtrip.cpp
+// Website:       http://midifile.sapp.org
+// Syntax:        C++17
+// vim:           ts=3 noexpandtab
+//
+// Description:   Tests of writing a MidiFile and reading it back, with
+//                and without running status, payload views and parallel
+//                track encoding, and of reading running-status input.
+//
+
+#include "MidiFile.h"
+#include "TestCheck.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace smf;
+
+
+//////////////////////////////
+//
+// makeTestFile -- A file with a conductor track and two tracks of
+//     channel messages, including runs of messages with the same command
+//     byte which are interrupted by meta and system-exclusive messages.
+//
+
+static void makeTestFile(MidiFile& midifile) {
+	midifile.addTracks(2);
+	midifile.setTicksPerQuarterNote(480);
+	midifile.addTrackName(0, 0, "conductor");
+	midifile.addTempo(0, 0, 96.0);
+	midifile.addTimeSignature(0, 0, 6, 8);
+	midifile.addTempo(0, 1920, 120.0);
+
+	midifile.addTrackName(1, 0, "piano");
+	midifile.addPatchChange(1, 0, 0, 1);
+	for (int i=0; i<16; i++) {
+		midifile.addNoteOn(1, i * 120, 0, 60 + i, 64 + i);
+		midifile.addNoteOn(1, i * 120 + 100, 0, 60 + i, 0);
+	}
+	midifile.addController(1, 960, 0, 64, 127);
+	midifile.addController(1, 960, 0, 7, 100);
+	midifile.addText(1, 1000, "running status is cleared here");
+	std::vector<uchar> sysex = {0xf0, 0x7e, 0x7f, 0x09, 0x01, 0xf7};
+	midifile.addEvent(1, 1500, sysex);
+	std::vector<uchar> raw = {0xf7, 0x43, 0x12};
+	midifile.addEvent(1, 1600, raw);
+	for (int i=0; i<8; i++) {
+		midifile.addNoteOff(1, 2000 + i, 0, 40 + i, 32);
+	}
+	midifile.addPitchBend(1, 2100, 0, 0.25);
+	midifile.addPitchBend(1, 2101, 0, -0.5);
+
+	std::vector<uchar> pressure = {0xd1, 0x40};
+	std::vector<uchar> aftertouch = {0xa1, 0x3c, 0x20};
+	for (int i=0; i<4; i++) {
+		midifile.addNoteOn(2, 0, 9, 36 + i, 100);
+		pressure[1] = (uchar)(0x40 + i);
+		midifile.addEvent(2, 10 + i, pressure);
+		midifile.addEvent(2, 20 + i, aftertouch);
+	}
+	// a delta time which needs a four-byte VLV:
+	midifile.addNoteOn(2, 0x0fffff0, 9, 42, 1);
+	midifile.addNoteOff(2, 0x0fffff1, 9, 42);
+	midifile.sortTracks();
+}
+
+
+
+//////////////////////////////
+//
+// getBytes -- Return the bytes of an event, including a payload view.
+//
+
+static std::vector<uchar> getBytes(const MidiEvent& event) {
+	MidiMessage message = event.getFullMessage();
+	const std::vector<uchar>& bytes = message;
+	return bytes;
+}
+
+
+
+//////////////////////////////
+//
+// checkSameEvents -- The events of a file which was read back must be the
+//     same as the written ones, apart from the end-of-track messages which
+//     are added when writing.
+//
+
+static void checkSameEvents(const MidiFile& written, const MidiFile& read) {
+	CHECK(read.getTrackCount() == written.getTrackCount());
+	CHECK(read.getTicksPerQuarterNote() == written.getTicksPerQuarterNote());
+	if (read.getTrackCount() != written.getTrackCount()) {
+		return;
+	}
+	for (int track=0; track<written.getTrackCount(); track++) {
+		const MidiEventList& expected = written[track];
+		const MidiEventList& actual = read[track];
+		CHECK(actual.size() == expected.size() + 1);
+		if (actual.size() != expected.size() + 1) {
+			continue;
+		}
+		for (int i=0; i<expected.size(); i++) {
+			CHECK(actual[i].tick == expected[i].tick);
+			CHECK(actual[i].track == track);
+			CHECK(getBytes(actual[i]) == getBytes(expected[i]));
+		}
+		CHECK(actual.back().isEndOfTrack());
+	}
+}
+
+
+
+//////////////////////////////
+//
+// countRunningStatus -- Return the number of command bytes which are left
+//     out when writing with running status: channel messages with the same
+//     command as the previous channel message, if there is no meta or
+//     system-exclusive message between them.
+//
+
+static int countRunningStatus(const MidiFile& midifile) {
+	int count = 0;
+	for (int track=0; track<midifile.getTrackCount(); track++) {
+		int status = 0;
+		for (int i=0; i<midifile[track].size(); i++) {
+			int command = midifile[track][i][0];
+			if (command >= 0xf0) {
+				status = 0;
+			} else if (command == status) {
+				count++;
+			} else {
+				status = command;
+			}
+		}
+	}
+	return count;
+}
+
+
+
+//////////////////////////////
+//
+// testRoundTrip -- Write the test file with each combination of options,
+//     and read it back.
+//
+
+static void testRoundTrip(void) {
+	MidiFile midifile;
+	makeTestFile(midifile);
+	int omitted = countRunningStatus(midifile);
+	CHECK(omitted > 20);
+
+	std::vector<uchar> plain;
+	CHECK(midifile.write(plain));
+	for (int options=0; options<8; options++) {
+		bool running = options & 1;
+		bool views = options & 2;
+		bool threads = options & 4;
+		midifile.setRunningStatus(running);
+		midifile.setWriteThreads(threads ? 0 : 1);
+		std::vector<uchar> output;
+		CHECK(midifile.write(output));
+		CHECK(output.size() == plain.size() - (running ? omitted : 0));
+
+		// The stream version writes the same bytes.
+		std::stringstream stream;
+		CHECK(midifile.write(stream));
+		std::string streambytes = stream.str();
+		CHECK(std::vector<uchar>(streambytes.begin(), streambytes.end()) == output);
+
+		MidiFile reread;
+		reread.setPayloadViews(views);
+		CHECK(reread.read(output.data(), output.size()));
+		checkSameEvents(midifile, reread);
+
+		// Writing the file which was read gives the same bytes.
+		reread.setRunningStatus(running);
+		std::vector<uchar> again;
+		CHECK(reread.write(again));
+		CHECK(again == output);
+	}
+}
+
+
+
+//////////////////////////////
+//
+// testReadRunningStatus -- Read a track which uses running status,
+//     including after a delta time which needs two VLV bytes.
+//
+
+static void testReadRunningStatus(void) {
+	std::vector<uchar> data = {
+		'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0, 96,
+		'M', 'T', 'r', 'k', 0, 0, 0, 23,
+		0x00, 0x90, 0x3c, 0x40,   // note on
+		0x60, 0x3c, 0x00,         // note off (running status)
+		0x00, 0x3e, 0x50,         // note on (running status)
+		0x81, 0x00, 0x3e, 0x00,   // note off after 128 ticks
+		0x00, 0xc2, 0x05,         // patch change
+		0x01, 0x06,               // patch change (running status)
+		0x00, 0xff, 0x2f, 0x00    // end of track
+	};
+	MidiFile midifile;
+	CHECK(midifile.read(data.data(), data.size()));
+	CHECK(midifile.getTrackCount() == 1);
+	CHECK(midifile[0].size() == 7);
+	if (midifile[0].size() != 7) {
+		return;
+	}
+	std::vector<int> ticks = {0, 96, 96, 224, 224, 225, 225};
+	std::vector<std::vector<uchar>> bytes = {
+		{0x90, 0x3c, 0x40}, {0x90, 0x3c, 0x00}, {0x90, 0x3e, 0x50},
+		{0x90, 0x3e, 0x00}, {0xc2, 0x05}, {0xc2, 0x06}, {0xff, 0x2f, 0x00}
+	};
+	for (int i=0; i<7; i++) {
+		CHECK(midifile[0][i].tick == ticks[i]);
+		CHECK(getBytes(midifile[0][i]) == bytes[i]);
+	}
+
+	// Writing with running status gives the same track data.
+	midifile.setRunningStatus(true);
+	std::vector<uchar> output;
+	CHECK(midifile.write(output));
+	CHECK(output == data);
+
+	// Running status cannot continue after a meta message.
+	std::vector<uchar> bad = {
+		'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0, 96,
+		'M', 'T', 'r', 'k', 0, 0, 0, 16,
+		0x00, 0x90, 0x3c, 0x40,
+		0x00, 0xff, 0x01, 0x01, 0x41,
+		0x00, 0x3c, 0x00,
+		0x00, 0xff, 0x2f, 0x00
+	};
+	MidiFile badfile;
+	std::stringstream errors;
+	std::streambuf* oldbuffer = std::cerr.rdbuf(errors.rdbuf());
+	bool status = badfile.read(bad.data(), bad.size());
+	std::cerr.rdbuf(oldbuffer);
+	CHECK(!status);
+}
+
+
+
+//////////////////////////////
+//
+// main --
+//
+
+int main(void) {
+	testRoundTrip();
+	testReadRunningStatus();
+	return testResult();
+}
+
+
+
@@ -0,0 +1,133 @@
+//
+// Creation Date: Mon Oct 19 18:05:12 PDT 2026
+// Filename:      midifile/tests/test_vlv.cpp
+// Website:       http://midifile.sapp.org
+// Syntax:        C++17
+// vim:           ts=3 noexpandtab
+//
+// Description:   Tests of the VLV codec (Vlv.h): encoding of the byte
+//                length boundaries, decoding with short spans (the
+//                byte-by-byte path) and with padded spans (the word path),
+//                and rejection of truncated and too-long values.
+//
+
+#include "Vlv.h"
+#include "TestCheck.h"
+
+#include <random>
+#include <vector>
+
+using namespace smf;
+
+
+//////////////////////////////
+//
+// checkValue -- Encode a value, and decode it again from a span of
+//     exactly its length and from a span with padding after it.
+//
+
+static void checkValue(ulong value) {
+	uchar buffer[8] = {0};
+	int count = Vlv::encode(value, buffer);
+	CHECK(count == Vlv::length(value));
+	for (int i=0; i<count-1; i++) {
+		CHECK(buffer[i] & 0x80);
+	}
+	CHECK(!(buffer[count-1] & 0x80));
+
+	ulong output = 0;
+	CHECK(Vlv::decode(buffer, count, output) == count);
+	CHECK(output == value);
+
+	buffer[count]   = 0xff;   // padding with continuation bits
+	buffer[count+1] = 0x81;
+	buffer[count+2] = 0x7f;
+	output = 0;
+	CHECK(Vlv::decode(buffer, 8, output) == count);
+	CHECK(output == value);
+}
+
+
+
+//////////////////////////////
+//
+// testBoundaries -- Values at the limits of each VLV length.
+//
+
+static void testBoundaries(void) {
+	struct Expected {
+		ulong value;
+		std::vector<uchar> bytes;
+	};
+	std::vector<Expected> expected = {
+		{0x00000000, {0x00}},
+		{0x0000007f, {0x7f}},
+		{0x00000080, {0x81, 0x00}},
+		{0x00002000, {0xc0, 0x00}},
+		{0x00003fff, {0xff, 0x7f}},
+		{0x00004000, {0x81, 0x80, 0x00}},
+		{0x001fffff, {0xff, 0xff, 0x7f}},
+		{0x00200000, {0x81, 0x80, 0x80, 0x00}},
+		{0x08000000, {0xc0, 0x80, 0x80, 0x00}},
+		{0x0fffffff, {0xff, 0xff, 0xff, 0x7f}}
+	};
+	for (auto& item : expected) {
+		uchar buffer[8] = {0};
+		int count = Vlv::encode(item.value, buffer);
+		CHECK(std::vector<uchar>(buffer, buffer + count) == item.bytes);
+		checkValue(item.value);
+	}
+	// Values over 0x0fffffff need five bytes (which decode() rejects).
+	CHECK(Vlv::length(0x10000000) == 5);
+	CHECK(Vlv::length(0xffffffff) == 5);
+}
+
+
+
+//////////////////////////////
+//
+// testRandom -- Random values of each length.
+//
+
+static void testRandom(void) {
+	std::mt19937 generator(29);
+	for (int i=0; i<100000; i++) {
+		int bits = 1 + i % 28;
+		checkValue(generator() & ((1UL << bits) - 1));
+	}
+}
+
+
+
+//////////////////////////////
+//
+// testInvalid -- Truncated values and values longer than 4 bytes.
+//
+
+static void testInvalid(void) {
+	ulong value = 12345;
+	const uchar truncated[3] = {0x81, 0x80, 0x80};
+	for (int size=0; size<=3; size++) {
+		CHECK(Vlv::decode(truncated, size, value) == 0);
+	}
+	const uchar toolong[5] = {0x81, 0x80, 0x80, 0x80, 0x00};
+	CHECK(Vlv::decode(toolong, 5, value) == 0);
+	CHECK(value == 12345);
+}
+
+
+
+//////////////////////////////
+//
+// main --
+//
+
+int main(void) {
+	testBoundaries();
+	testRandom();
+	testInvalid();
+	return testResult();
+}
+
+
+